@@ -26,13 +26,41 @@ import zipfile
 import base64
 
 
+class ThreadingHTTPServer(socketserver.ThreadingMixIn, HTTPServer):
+    """HTTP server with a thread per connection; idle keep-alive clients must not block others."""
+    daemon_threads = True
+
+
 class LitheServerHandler(BaseHTTPRequestHandler):
     """HTTP request handler for LitheServer."""
     
+    # Persistent connections, so a reverse proxy can keep its upstream connections alive.
+    # Every response with a body carries Content-Length.
+    protocol_version = "HTTP/1.1"
+    
     def __init__(self, *args, directory=None, **kwargs):
         self.directory = directory or os.getcwd()
+        self._response_started = False
         super().__init__(*args, **kwargs)
     
+    def handle_one_request(self):
+        """Handle one request on a persistent connection."""
+        self._response_started = False
+        super().handle_one_request()
+    
+    def end_headers(self):
+        """Finish the response headers and remember that a response is in flight."""
+        self._response_started = True
+        super().end_headers()
+    
+    def send_error(self, code, message=None, explain=None):
+        """Send an error response, or close the connection if a response is already in flight."""
+        if self._response_started:
+            # Failed mid-body: a second response would desynchronise the connection
+            self.close_connection = True
+            return
+        super().send_error(code, message, explain)
+    
     def do_GET(self):
         """Handle GET requests."""
         self._handle_request()
@@ -149,6 +177,8 @@ class LitheServerHandler(BaseHTTPRequestHandler):
     
     def do_POST(self):
         """Handle POST requests (file uploads)."""
+        # Error paths below may leave the request body unread; never reuse the connection
+        self.close_connection = True
         try:
             # Parse URL
             parsed_path = urllib.parse.urlparse(self.path)
@@ -936,6 +966,9 @@ class LitheServerHandler(BaseHTTPRequestHandler):
     
     def send_json_response(self, status_code, data):
         """Send JSON response with proper headers."""
+        if self._response_started:
+            self.close_connection = True
+            return
         response_json = json.dumps(data)
         self.send_response(status_code)
         self.send_header('Content-Type', 'application/json')
@@ -3001,7 +3034,7 @@ class LitheServer:
             return LitheServerHandler(*args, directory=self.directory, **kwargs)
         
         try:
-            self.httpd = HTTPServer((self.host, self.port), handler_factory)
+            self.httpd = ThreadingHTTPServer((self.host, self.port), handler_factory)
             
             print(f"\n🚀 LitheServer starting...")
             print(f"📁 Serving directory: {self.directory}")
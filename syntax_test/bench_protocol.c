@@ -0,0 +1,424 @@
+/**
+ * LitheServer 协议函数微基准测试
+ * 覆盖 parse_http_request / build_http_response / send_http_response
+ *
+ * 编译与运行：
+ *   gcc -O2 -pthread -o bench_protocol bench_protocol.c
+ *   ./bench_protocol --corpus bench_corpus.http                  # 输出 JSON 结果
+ *   ./bench_protocol --save-baseline bench_baseline.json         # 记录本机基线
+ *   ./bench_protocol --baseline bench_baseline.json              # 与基线对比，按各轮最小值比较，回归或用例不一致时返回 1
+ *
+ * 语料文件由若干条真实抓取的请求组成，以单独一行 "%%" 分隔，
+ * 行尾统一按 CRLF 还原。
+ *
+ * @author xyanmi
+ * @date 2025-06-01
+ */
+
+#define LITHE_NO_MAIN
+#include "example.c"
+
+// 宏定义
+#define BENCH_MAX_CASES 32
+#define BENCH_MAX_CORPUS 64
+#define BENCH_RUNS 7
+#define BENCH_ROUNDS 3                // 所有用例轮流跑 3 遍，分散一时的机器抖动
+#define BENCH_MIN_RUN_NS 50000000LL   // 每轮至少运行 50ms
+#define BENCH_SEND_BATCH 32           // 每批发送后清空 socketpair，避免阻塞
+#define BENCH_DEFAULT_TOLERANCE 0.25  // 允许 25% 的抖动（按最小值比较）
+
+// 结构体定义
+typedef struct {
+    const char* name;
+    void (*setup)(void);
+    void (*run)(long iterations);
+    void (*teardown)(void);
+} bench_case_t;
+
+typedef struct {
+    char name[64];
+    double ns_per_op;
+    double min_ns_per_op;
+    long iterations;
+} bench_result_t;
+
+// 全局变量
+static char* corpus[BENCH_MAX_CORPUS];
+static int corpus_count = 0;
+static int bench_sockets[2] = { -1, -1 };
+static http_response_t bench_responses[3];
+static volatile int bench_sink = 0;
+
+/**
+ * 获取单调时钟纳秒数
+ */
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * 追加一条语料，LF 行尾还原为 CRLF
+ */
+static void corpus_add(const char* text, size_t len) {
+    char* request;
+    size_t j = 0;
+
+    // 去掉分隔符前后的空行，只保留头部结束所需的一个空行
+    while (len > 0 && text[len - 1] == '\n') {
+        --len;
+    }
+    if (len == 0 || corpus_count >= BENCH_MAX_CORPUS) {
+        return;
+    }
+
+    request = malloc(len * 2 + 8);
+    if (!request) {
+        return;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (text[i] == '\n' && (i == 0 || text[i - 1] != '\r')) {
+            request[j++] = '\r';
+        }
+        request[j++] = text[i];
+    }
+    request[j] = '\0';
+    // 无请求体的请求补回头部结束的空行
+    if (strstr(request, "\r\n\r\n") == NULL) {
+        memcpy(request + j, "\r\n\r\n", 5);
+    }
+    corpus[corpus_count++] = request;
+}
+
+/**
+ * 加载请求语料文件
+ * @return 成功返回0，失败返回-1
+ */
+static int load_corpus(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    char* content;
+    char* start;
+    char* sep;
+    long size;
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    content = malloc(size + 1);
+    if (!content || fread(content, 1, size, fp) != (size_t)size) {
+        fclose(fp);
+        free(content);
+        return -1;
+    }
+    content[size] = '\0';
+    fclose(fp);
+
+    start = content;
+    while ((sep = strstr(start, "\n%%\n")) != NULL) {
+        corpus_add(start, sep - start + 1);
+        start = sep + 4;
+    }
+    corpus_add(start, strlen(start));
+    free(content);
+
+    return corpus_count > 0 ? 0 : -1;
+}
+
+// ---------- 基准用例 ----------
+
+static void bench_parse_run(long iterations) {
+    http_request_t request;
+
+    for (long i = 0; i < iterations; ++i) {
+        bench_sink += parse_http_request(corpus[i % corpus_count], &request);
+    }
+}
+
+static void bench_build_run(long iterations) {
+    static const char* bodies[] = {
+        "<h1>200</h1>",
+        "{\"status\":\"ok\",\"server\":\"LitheServer/1.0\",\"uptime\":42}",
+        "<h1>404</h1>",
+    };
+    static const int codes[] = { 200, 200, 404 };
+    static const char* types[] = { CONTENT_TYPE_HTML_LINE, CONTENT_TYPE_JSON_LINE, CONTENT_TYPE_HTML_LINE };
+    http_response_t response;
+
+    for (long i = 0; i < iterations; ++i) {
+        int k = (int)(i % 3);
+        build_http_response(&response, codes[k], types[k], bodies[k]);
+        bench_sink += (int)response.content_length;
+    }
+}
+
+static void bench_send_setup(void) {
+    int size = 1 << 20;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, bench_sockets) < 0) {
+        perror("socketpair failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(bench_sockets[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(bench_sockets[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    fcntl(bench_sockets[1], F_SETFL, O_NONBLOCK);
+
+    build_http_response(&bench_responses[0], 200, CONTENT_TYPE_HTML_LINE, "<h1>200</h1>");
+    build_http_response(&bench_responses[1], 200, CONTENT_TYPE_JSON_LINE,
+                        "{\"entries\":[\"example.c\",\"example.cpp\",\"styles.css\"]}");
+    build_http_response(&bench_responses[2], 404, CONTENT_TYPE_HTML_LINE, "<h1>404</h1>");
+}
+
+static void bench_send_drain(void) {
+    char sink[65536];
+
+    while (recv(bench_sockets[1], sink, sizeof(sink), 0) > 0) {
+        bench_sink += sink[0];
+    }
+}
+
+static void bench_send_run(long iterations) {
+    for (long i = 0; i < iterations; ++i) {
+        send_http_response(bench_sockets[0], &bench_responses[i % 3]);
+        if ((i + 1) % BENCH_SEND_BATCH == 0) {
+            bench_send_drain();
+        }
+    }
+    bench_send_drain();
+}
+
+static void bench_send_teardown(void) {
+    close(bench_sockets[0]);
+    close(bench_sockets[1]);
+    bench_sockets[0] = bench_sockets[1] = -1;
+}
+
+// 新增热点函数（路由、头部缓存等）时在此登记即可
+static const bench_case_t bench_cases[] = {
+    { "parse_http_request",  NULL,             bench_parse_run, NULL },
+    { "build_http_response", NULL,             bench_build_run, NULL },
+    { "send_http_response",  bench_send_setup, bench_send_run,  bench_send_teardown },
+};
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * 运行单个用例：先标定迭代次数，再取多轮中位数
+ */
+static void run_case(const bench_case_t* bench, bench_result_t* result) {
+    double samples[BENCH_RUNS];
+    long iterations = 64;
+    long long elapsed;
+
+    if (bench->setup) bench->setup();
+
+    // 标定：使单轮耗时不少于 BENCH_MIN_RUN_NS
+    for (;;) {
+        long long start = now_ns();
+        bench->run(iterations);
+        elapsed = now_ns() - start;
+        if (elapsed >= BENCH_MIN_RUN_NS || iterations >= (1L << 30)) {
+            break;
+        }
+        iterations *= elapsed > 0 && BENCH_MIN_RUN_NS / elapsed < 8 ? 2 : 8;
+    }
+
+    for (int run = 0; run < BENCH_RUNS; ++run) {
+        long long start = now_ns();
+        bench->run(iterations);
+        samples[run] = (double)(now_ns() - start) / (double)iterations;
+    }
+
+    if (bench->teardown) bench->teardown();
+
+    qsort(samples, BENCH_RUNS, sizeof(double), compare_double);
+    snprintf(result->name, sizeof(result->name), "%s", bench->name);
+    result->ns_per_op = samples[BENCH_RUNS / 2];
+    result->min_ns_per_op = samples[0];
+    result->iterations = iterations;
+}
+
+/**
+ * 以 JSON 输出结果，每个用例独占一行，便于逐行解析基线
+ */
+static void write_results(FILE* out, const bench_result_t* results, int count) {
+    fprintf(out, "{\"benchmarks\": [\n");
+    for (int i = 0; i < count; ++i) {
+        fprintf(out, "  {\"name\": \"%s\", \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, \"iterations\": %ld}%s\n",
+                results[i].name, results[i].ns_per_op, results[i].min_ns_per_op,
+                results[i].iterations, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]}\n");
+}
+
+/**
+ * 与基线逐项比较。比较各轮中的最小值：中位数在共享机器上抖动可超过 20%，
+ * 最小值受调度干扰最小。基线缺失用例、当前缺失用例或基线数值无效都算失败
+ * @param filter 与 --filter 相同，不匹配的基线用例不参与比较
+ * @return 存在回归或用例不一致返回1，否则返回0；基线无法读取返回-1
+ */
+static int compare_baseline(const char* path, const char* filter, const bench_result_t* results, int count,
+                            double tolerance) {
+    FILE* fp = fopen(path, "r");
+    char line[512];
+    int matched[BENCH_MAX_CASES] = { 0 };
+    int failures = 0;
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        char name[64];
+        double median_ns;
+        double baseline_ns;
+        int found = 0;
+
+        if (sscanf(line, " {\"name\": \"%63[^\"]\"", name) != 1) {
+            continue;
+        }
+        if (filter && strstr(name, filter) == NULL) {
+            continue;
+        }
+        if (sscanf(line, " {\"name\": \"%*[^\"]\", \"ns_per_op\": %lf, \"min_ns_per_op\": %lf",
+                   &median_ns, &baseline_ns) != 2 || !(baseline_ns > 0.0)) {
+            fprintf(stderr, "%-24s invalid baseline entry, re-run --save-baseline\n", name);
+            ++failures;
+            continue;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (strcmp(results[i].name, name) != 0) {
+                continue;
+            }
+            double ratio = results[i].min_ns_per_op / baseline_ns;
+            int regressed = ratio > 1.0 + tolerance;
+            fprintf(stderr, "%-24s baseline %10.2f ns  current %10.2f ns  %+6.1f%%%s\n",
+                    name, baseline_ns, results[i].min_ns_per_op, (ratio - 1.0) * 100.0,
+                    regressed ? "  REGRESSION" : "");
+            failures += regressed;
+            matched[i] = found = 1;
+        }
+        if (!found) {
+            fprintf(stderr, "%-24s in baseline but not run\n", name);
+            ++failures;
+        }
+    }
+    fclose(fp);
+
+    for (int i = 0; i < count; ++i) {
+        if (!matched[i]) {
+            fprintf(stderr, "%-24s missing from baseline\n", results[i].name);
+            ++failures;
+        }
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [--corpus FILE] [--filter NAME] [--out FILE]\n"
+            "          [--baseline FILE] [--save-baseline FILE] [--tolerance RATIO]\n",
+            prog);
+}
+
+/**
+ * 主函数
+ */
+int main(int argc, char* argv[]) {
+    const char* corpus_path = "bench_corpus.http";
+    const char* filter = NULL;
+    const char* out_path = NULL;
+    const char* baseline_path = NULL;
+    const char* save_path = NULL;
+    double tolerance = BENCH_DEFAULT_TOLERANCE;
+    bench_result_t results[BENCH_MAX_CASES];
+    int result_count = 0;
+    int status = EXIT_SUCCESS;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+            corpus_path = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (load_corpus(corpus_path) != 0) {
+        fprintf(stderr, "Failed to load request corpus: %s\n", corpus_path);
+        return EXIT_FAILURE;
+    }
+
+    // 基准期间静默服务器日志，避免 I/O 干扰计时
+    log_min_level = LOG_LEVEL_NONE;
+    signal(SIGPIPE, SIG_IGN);
+
+    // 各用例交替运行多遍，每项统计取各遍中最好的一次
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        result_count = 0;
+        for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); ++i) {
+            bench_result_t result;
+
+            if (filter && strstr(bench_cases[i].name, filter) == NULL) {
+                continue;
+            }
+            run_case(&bench_cases[i], &result);
+            if (round == 0) {
+                results[result_count] = result;
+            } else {
+                bench_result_t* best = &results[result_count];
+                if (result.ns_per_op < best->ns_per_op) best->ns_per_op = result.ns_per_op;
+                if (result.min_ns_per_op < best->min_ns_per_op) best->min_ns_per_op = result.min_ns_per_op;
+            }
+            ++result_count;
+        }
+    }
+
+    write_results(stdout, results, result_count);
+
+    const char* outputs[] = { out_path, save_path };
+    for (int i = 0; i < 2; ++i) {
+        FILE* fp;
+        if (!outputs[i]) {
+            continue;
+        }
+        fp = fopen(outputs[i], "w");
+        if (!fp) {
+            perror(outputs[i]);
+            return EXIT_FAILURE;
+        }
+        write_results(fp, results, result_count);
+        fclose(fp);
+    }
+
+    if (baseline_path) {
+        int rc = compare_baseline(baseline_path, filter, results, result_count, tolerance);
+        if (rc != 0) {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    for (int i = 0; i < corpus_count; ++i) {
+        free(corpus[i]);
+    }
+    return status;
+}
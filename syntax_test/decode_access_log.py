@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""
+解码 C 服务器写出的二进制访问日志（--access-log）
+
+    python3 decode_access_log.py access.bin              # 逐行文本
+    python3 decode_access_log.py --json access.bin       # 每行一个 JSON 对象
+    python3 decode_access_log.py --stats access.bin      # 热门路径、状态码分布、延迟分位数
+
+文件格式（与 example.c 中 access_log_record 一致）：
+    段头      8 字节魔数 LITHEAL1 + varint 基准时间（Unix 微秒），每次写出的缓冲区自成一段
+    字符串    0x01, varint id, varint 长度, 字节；id 在段内有效，0 表示空字符串
+    请求      0x02, zigzag varint 时间差（微秒）, 4 字节 IPv4, varint 方法,
+              varint 路径 id, varint UA id, varint 状态码, varint 字节数, varint 耗时（微秒）
+"""
+
+import argparse
+import collections
+import datetime
+import ipaddress
+import json
+import sys
+
+MAGIC = b'LITHEAL1'
+RECORD_STRING = 1
+RECORD_REQUEST = 2
+METHODS = ('-', 'GET', 'HEAD', 'POST', 'PUT', 'DELETE', 'OPTIONS', 'PATCH')
+
+
+class FormatError(Exception):
+    pass
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def at_end(self):
+        return self.pos >= len(self.data)
+
+    def byte(self):
+        if self.pos >= len(self.data):
+            raise FormatError('truncated record')
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise FormatError('truncated record')
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+    def varint(self):
+        result = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            result |= (b & 0x7f) << shift
+            if b < 0x80:
+                return result
+            shift += 7
+
+
+def decode(data):
+    """逐条产出请求记录（dict）"""
+    reader = Reader(data)
+    strings = {0: ''}
+    timestamp = None
+
+    while not reader.at_end():
+        if data.startswith(MAGIC, reader.pos):
+            reader.pos += len(MAGIC)
+            timestamp = reader.varint()
+            strings = {0: ''}
+            continue
+        if timestamp is None:
+            raise FormatError('missing segment header')
+
+        kind = reader.byte()
+        if kind == RECORD_STRING:
+            string_id = reader.varint()
+            strings[string_id] = reader.take(reader.varint()).decode('utf-8', 'replace')
+        elif kind == RECORD_REQUEST:
+            delta = reader.varint()
+            timestamp += (delta >> 1) ^ -(delta & 1)
+            ip = reader.take(4)
+            method = reader.varint()
+            path = strings.get(reader.varint(), '?')
+            agent = strings.get(reader.varint(), '?')
+            yield {
+                'time': timestamp / 1e6,
+                'client': str(ipaddress.IPv4Address(ip)) if ip != b'\0\0\0\0' else 'unix',
+                'method': METHODS[method] if method < len(METHODS) else '-',
+                'path': path,
+                'user_agent': agent,
+                'status': reader.varint(),
+                'bytes': reader.varint(),
+                'latency_us': reader.varint(),
+            }
+        else:
+            raise FormatError(f'unknown record type {kind} at offset {reader.pos - 1}')
+
+
+def read_records(data):
+    """同 decode，但遇到损坏或被截断的尾部时给出警告并停止，而不是抛出异常"""
+    try:
+        yield from decode(data)
+    except FormatError as e:
+        # 进程被强制终止时最后一批记录可能不完整
+        print(f'warning: {e}', file=sys.stderr)
+
+
+def format_text(record):
+    when = datetime.datetime.fromtimestamp(record['time']).strftime('%Y-%m-%d %H:%M:%S.%f')[:-3]
+    return (f'{when} {record["client"]} "{record["method"]} {record["path"]}" {record["status"]} '
+            f'{record["bytes"]} {record["latency_us"] / 1000:.2f}ms "{record["user_agent"]}"')
+
+
+def percentile(sorted_values, fraction):
+    if not sorted_values:
+        return 0
+    index = min(len(sorted_values) - 1, int(fraction * len(sorted_values)))
+    return sorted_values[index]
+
+
+def print_stats(records, top):
+    paths = collections.Counter(r['path'] for r in records)
+    statuses = collections.Counter(r['status'] for r in records)
+    latencies = sorted(r['latency_us'] for r in records)
+    total = len(records)
+
+    print(f'requests: {total}')
+    if not total:
+        return
+    print(f'bytes: {sum(r["bytes"] for r in records)}')
+    print('\ntop paths:')
+    for path, count in paths.most_common(top):
+        print(f'  {count:8d}  {count * 100 / total:5.1f}%  {path}')
+    print('\nstatus:')
+    for status, count in sorted(statuses.items()):
+        print(f'  {status:3d}  {count:8d}  {count * 100 / total:5.1f}%')
+    print('\nlatency (ms):')
+    for label, fraction in (('p50', 0.50), ('p90', 0.90), ('p99', 0.99), ('p999', 0.999)):
+        print(f'  {label:5s} {percentile(latencies, fraction) / 1000:10.2f}')
+    print(f'  {"max":5s} {latencies[-1] / 1000:10.2f}')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the C server binary access log')
+    parser.add_argument('log', help='access log file written with --access-log')
+    group = parser.add_mutually_exclusive_group()
+    group.add_argument('--json', action='store_true', help='print one JSON object per request')
+    group.add_argument('--stats', action='store_true', help='print aggregates instead of records')
+    parser.add_argument('--top', type=int, default=10, help='number of paths shown by --stats')
+    args = parser.parse_args()
+
+    with open(args.log, 'rb') as f:
+        data = f.read()
+
+    records = read_records(data)
+    try:
+        if args.stats:
+            print_stats(list(records), args.top)
+        else:
+            for record in records:
+                print(json.dumps(record, ensure_ascii=False) if args.json else format_text(record))
+    except BrokenPipeError:
+        pass
+
+
+if __name__ == '__main__':
+    main()
@@ -6,15 +6,49 @@
  * @date 2025-06-01
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             // pthread_setaffinity_np、SO_INCOMING_CPU 等扩展
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <stddef.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <strings.h>
+#include <ctype.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <limits.h>
+#include <stdatomic.h>
+
+// USDT 静态探针：有 sys/sdt.h 时编译为 nop 指令，可由 bpftrace/perf/SystemTap 动态挂载
+#if defined(__has_include) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LITHE_PROBE1(name, a) DTRACE_PROBE1(litheserver, name, a)
+#define LITHE_PROBE2(name, a, b) DTRACE_PROBE2(litheserver, name, a, b)
+#else
+#define LITHE_PROBE1(name, a) ((void)(a))
+#define LITHE_PROBE2(name, a, b) ((void)(a), (void)(b))
+#endif
 
 // 宏定义
 #define MAX_BUFFER_SIZE 1024
@@ -22,11 +56,111 @@
 #define BACKLOG 10
 #define MAX_CLIENTS 100
 
+// 按客户端 IP 限流
+#define RATE_LIMIT_SHARDS 16            // 分片数（2 的幂），每片独立加锁
+#define RATE_LIMIT_SLOTS 1024           // 每个分片的槽位数（2 的幂）
+#define RATE_LIMIT_PROBE_WINDOW 8       // 开放寻址的最大探测长度
+#define RATE_LIMIT_MAX_CONNECTIONS 16   // 单 IP 并发连接上限
+#define RATE_LIMIT_RATE 20.0            // 每秒补充的请求令牌数
+#define RATE_LIMIT_BURST 40.0           // 令牌桶容量
+
+// 工作线程与过载保护
+#define WORKER_COUNT 4                  // 未绑核时的工作线程数
+#define MAX_WORKERS 64                  // 绑核时按允许的 CPU 数创建，上限
+#define CONNECTION_QUEUE_SIZE 256
+#define CODEL_TARGET_NS 5000000LL       // 排队时间目标：5ms
+#define CODEL_INTERVAL_NS 100000000LL   // 观察窗口：100ms
+
+// 文件描述符/元数据缓存与 inotify 失效
+#define FILE_CACHE_SLOTS 256            // 缓存槽位数（2 的幂）
+#define FILE_CACHE_PROBE_WINDOW 4
+#define INVALIDATION_QUEUE_SIZE 1024    // 失效通知环形队列容量
+#define FILE_WATCHER_MAX_WATCHES 4096   // 最多监视的目录数
+
+// 慢请求采样日志
+#define SLOW_REQUEST_THRESHOLD_MS 200   // 默认阈值，可用 --slow-ms 覆盖（负数关闭）
+#define SLOW_REQUEST_SAMPLE_RATE 8      // 每 N 个慢请求记录一个
+
+// GET API 响应微缓存（同一键的并发请求合并为一次计算）
+#define API_CACHE_SLOTS 64              // 槽位数（2 的幂）
+#define API_CACHE_PROBE_WINDOW 8
+#define API_CACHE_TTL_MS 1000           // 默认有效期，可用 --api-cache-ms 覆盖（0 关闭）
+#define API_CACHE_MAX_QUERY_PARAMS 16
+enum { API_CACHE_EMPTY = 0, API_CACHE_FILLING, API_CACHE_READY };
+
+// 二进制访问日志（格式见 access_log_record 与 decode_access_log.py）
+#define ACCESS_LOG_MAGIC "LITHEAL1"
+#define ACCESS_LOG_BUFFER_SIZE (256 * 1024)         // 双缓冲，每块大小
+#define ACCESS_LOG_FLUSH_THRESHOLD (64 * 1024)      // 攒到该大小即唤醒写线程
+#define ACCESS_LOG_FLUSH_INTERVAL_MS 1000
+#define ACCESS_LOG_INTERN_SLOTS 4096                // 字符串驻留表槽位数（2 的幂）
+#define ACCESS_LOG_INTERN_PROBE 8
+#define ACCESS_LOG_MAX_STRING 255
+#define ACCESS_LOG_MAX_RECORD (2 * (1 + 5 + 5 + ACCESS_LOG_MAX_STRING) + 64)
+enum { ACCESS_LOG_STRING = 1, ACCESS_LOG_REQUEST = 2 };
+
+// I/O 缓冲区池（大页）
+#define IO_BUFFER_SIZE 16384            // 单个缓冲区大小
+#define IO_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define IO_BUFFER_POOL_BYTES (4 * IO_HUGE_PAGE_SIZE)
+#define IO_BUFFER_COUNT (IO_BUFFER_POOL_BYTES / IO_BUFFER_SIZE)
+#define IO_BUFFER_LOCAL_CACHE 16        // 每线程空闲链表容量
+#define IO_BUFFER_BATCH 8               // 与全局空闲链表一次交换的数量
+
+// /api/ 上游代理
+#define UPSTREAM_POOL_SIZE 32               // 最多保留的空闲上游连接
+#define UPSTREAM_IDLE_TIMEOUT_NS 30000000000LL  // 空闲超过 30s 的连接不再复用
+#define UPSTREAM_IO_TIMEOUT_MS 30000        // 上游读写超时
+
+// 平滑升级：SIGUSR2 重新执行程序并经 SCM_RIGHTS 移交监听套接字
+#define UPGRADE_ENV "LITHE_UPGRADE_FD"
+#define UPGRADE_MAGIC "LITHEUP1"
+#define UPGRADE_CHANNEL_FD 3            // 新进程中移交通道的固定描述符
+#define UPGRADE_READY_TIMEOUT_MS 10000  // 等待新进程就绪的上限，超时放弃升级并继续服务
+#define UPGRADE_DRAIN_SECONDS 30        // 默认排空期限，可用 --drain-seconds 覆盖
+
+// HTTP/2（明文 h2c）
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN 24
+#define H2_FRAME_HEADER_SIZE 9
+#define H2_MAX_FRAME_SIZE 16384         // 双方默认的最大帧负载
+#define H2_MAX_STREAMS 32               // 通告的最大并发流数
+#define H2_HEADER_BLOCK_SIZE 16384      // 单个头部块上限
+#define H2_DEFAULT_WINDOW 65535
+#define H2_DEFAULT_URGENCY 3            // RFC 9218 默认紧急度
+#define H2_SEND_BURST 16                // 每轮最多连续发送的 DATA 帧数
+#define H2_IDLE_TIMEOUT_MS 5000         // 空闲连接占用工作线程的上限
+#define H2_IDLE_SLICE_MS 50             // 空闲等待的切片：每片检查队列中是否有连接在等工作线程
+#define HPACK_TABLE_SIZE 4096
+#define HPACK_MAX_ENTRIES (HPACK_TABLE_SIZE / 32)
+
+enum {
+    H2_FRAME_DATA = 0x0, H2_FRAME_HEADERS = 0x1, H2_FRAME_PRIORITY = 0x2, H2_FRAME_RST_STREAM = 0x3,
+    H2_FRAME_SETTINGS = 0x4, H2_FRAME_PUSH_PROMISE = 0x5, H2_FRAME_PING = 0x6, H2_FRAME_GOAWAY = 0x7,
+    H2_FRAME_WINDOW_UPDATE = 0x8, H2_FRAME_CONTINUATION = 0x9
+};
+enum {
+    H2_FLAG_END_STREAM = 0x1, H2_FLAG_ACK = 0x1, H2_FLAG_END_HEADERS = 0x4,
+    H2_FLAG_PADDED = 0x8, H2_FLAG_PRIORITY = 0x20
+};
+enum {
+    H2_NO_ERROR = 0x0, H2_PROTOCOL_ERROR = 0x1, H2_INTERNAL_ERROR = 0x2, H2_FLOW_CONTROL_ERROR = 0x3,
+    H2_FRAME_SIZE_ERROR = 0x6, H2_REFUSED_STREAM = 0x7, H2_COMPRESSION_ERROR = 0x9,
+    H2_ENHANCE_YOUR_CALM = 0xb
+};
+enum {
+    H2_SETTINGS_HEADER_TABLE_SIZE = 0x1, H2_SETTINGS_ENABLE_PUSH = 0x2, H2_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    H2_SETTINGS_INITIAL_WINDOW_SIZE = 0x4, H2_SETTINGS_MAX_FRAME_SIZE = 0x5, H2_SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+};
+
 // 常量定义
 const char* HTTP_200_OK = "HTTP/1.1 200 OK\r\n";
 const char* HTTP_404_NOT_FOUND = "HTTP/1.1 404 Not Found\r\n";
 const char* CONTENT_TYPE_HTML = "Content-Type: text/html\r\n";
 const char* CONTENT_TYPE_JSON = "Content-Type: application/json\r\n";
+// build_http_response 会自行追加 CRLF，因此传入不带换行的头部行
+#define CONTENT_TYPE_HTML_LINE "Content-Type: text/html; charset=utf-8"
+#define CONTENT_TYPE_JSON_LINE "Content-Type: application/json"
 
 // 结构体定义
 typedef struct {
@@ -36,12 +170,21 @@ typedef struct {
     time_t connect_time;
 } client_info_t;
 
+// Unix 域套接字对端凭据（SO_PEERCRED）；TCP 连接 valid 为 0
+typedef struct {
+    int valid;
+    pid_t pid;
+    uid_t uid;
+    gid_t gid;
+} peer_credentials_t;
+
 typedef struct {
     char method[16];
     char path[256];
     char version[16];
     char headers[MAX_BUFFER_SIZE];
     char body[MAX_BUFFER_SIZE];
+    peer_credentials_t peer;     // 由连接层填入，解析器不设置
 } http_request_t;
 
 typedef struct {
@@ -50,25 +193,407 @@ typedef struct {
     char headers[MAX_BUFFER_SIZE];
     char body[MAX_BUFFER_SIZE];
     size_t content_length;
+    const char* content_type;    // 不带 CRLF 的 Content-Type 头部行
 } http_response_t;
 
+// 交给 C++ 协程层（example_coro.cpp）的静态文件句柄，两边的定义需保持一致
+typedef struct {
+    int fd;                      // 与其他请求共享，只能按显式偏移读取（pread/sendfile）
+    uint64_t size;
+    const char* content_type;    // 不带 CRLF 的 Content-Type 头部行
+    void* handle;                // 文件缓存条目，关闭时交还
+} lithe_file_t;
+
+// 内嵌静态资源（由 gen_assets.py 生成 example_assets.h）
+enum { ASSET_IDENTITY = 0, ASSET_GZIP, ASSET_BROTLI, ASSET_ENCODINGS };
+
+typedef struct {
+    const unsigned char* body;   // NULL 表示没有该编码的版本
+    size_t body_len;
+    const char* headers;         // 完整序列化的 HTTP/1.1 响应头
+    size_t headers_len;
+} embedded_variant_t;
+
+typedef struct {
+    const char* path;
+    const char* etag;
+    const char* content_type;
+    const char* cache_control;
+    const char* not_modified;    // 预先序列化的 304 响应
+    size_t not_modified_len;
+    embedded_variant_t variants[ASSET_ENCODINGS];
+} embedded_asset_t;
+
+typedef struct {
+    uint32_t ip;                 // IPv4 地址（网络字节序）
+    uint32_t active_connections;
+    double tokens;
+    int64_t last_refill_ns;
+    int64_t last_seen_ns;        // 0 表示空槽，同时用于 LRU 淘汰
+} rate_limit_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    rate_limit_entry_t slots[RATE_LIMIT_SLOTS];
+} rate_limit_shard_t;
+
+// 连接各阶段的单调时间戳（未到达的阶段为 0）
+typedef struct {
+    int64_t accept_ns;
+    int64_t dequeue_ns;          // 工作线程取出连接
+    int64_t parsed_ns;           // 首个请求解析完成
+    int64_t handler_ns;          // 开始路由处理
+    int64_t first_byte_ns;       // 响应首字节发出
+    int64_t complete_ns;         // 响应完成
+    int status;                  // 响应状态码（首次发送时记录）
+    uint64_t bytes;              // 响应体长度
+    int multiplexed;             // HTTP/2 连接：请求由各流分别记录，连接本身不再记录
+    char method[16];
+    char path[128];
+    char user_agent[128];
+} request_timing_t;
+
+typedef struct {
+    int socket_fd;
+    struct sockaddr_in addr;
+    peer_credentials_t peer;     // Unix 域连接的对端凭据
+    int64_t enqueue_ns;          // 入队时间，用于计算排队时间
+    request_timing_t timing;
+} pending_connection_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pending_connection_t items[CONNECTION_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+    // CoDel 状态
+    int64_t interval_start_ns;
+    int64_t interval_min_sojourn_ns;
+    int overloaded;
+    uint64_t shed_count;
+} connection_queue_t;
+
+typedef struct {
+    char* base;                  // 整个池的起始地址（按大页对齐）
+    size_t size;
+    int huge_pages;              // 1: MAP_HUGETLB，0: 透明大页或普通页
+    pthread_mutex_t lock;
+    int free_count;
+    uint16_t free_list[IO_BUFFER_COUNT];
+} io_buffer_pool_t;
+
+typedef struct {
+    int count;
+    uint16_t items[IO_BUFFER_LOCAL_CACHE];
+} io_buffer_cache_t;
+
+typedef struct {
+    int configured;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    char label[128];
+    pthread_mutex_t lock;
+    int idle_count;
+    int idle_fds[UPSTREAM_POOL_SIZE];
+    int64_t idle_since_ns[UPSTREAM_POOL_SIZE];
+} upstream_pool_t;
+
+// 带缓冲的流读取器，用于边读边转发
+typedef struct {
+    int fd;
+    char* buffer;
+    size_t capacity;
+    size_t start;                // 未消费数据的起止位置
+    size_t end;
+    int received;                // 是否从 fd 读取过数据
+} stream_reader_t;
+
+typedef struct {
+    char key[256];               // 规范化的路径 + 查询串
+    uint64_t hash;
+    int state;                   // API_CACHE_*；FILLING 的条目不会被淘汰
+    int64_t expires_ns;
+    uint64_t generation;         // 生成时的文件变更代数，目录变化后立即失效
+    uint64_t last_used;
+    http_response_t response;
+} api_cache_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t filled;       // 任一条目生成结束时广播
+    api_cache_entry_t slots[API_CACHE_SLOTS];
+    uint64_t clock;
+    atomic_uint_fast64_t generation;  // inotify 线程每观察到一次变更加一
+    atomic_uint_fast64_t hits;
+    atomic_uint_fast64_t misses;
+    atomic_uint_fast64_t coalesced;   // 等待他人生成而非自己计算的请求数
+} api_cache_t;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t id;
+    char* value;
+} access_log_intern_t;
+
+typedef struct {
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t flush_needed;
+    pthread_t writer;
+    uint8_t* active;             // 工作线程写入的缓冲区
+    uint8_t* spare;              // 写线程正在落盘的缓冲区
+    size_t active_len;
+    size_t segment_header_len;   // active 开头的段头长度，只有段头时无需写出
+    int64_t last_timestamp_us;   // 上一条记录的时间戳，记录中只存差值
+    uint32_t next_id;
+    uint64_t dropped;            // 两块缓冲区都满时丢弃的记录数
+    access_log_intern_t interns[ACCESS_LOG_INTERN_SLOTS];
+} access_log_t;
+
+// 监听套接字移交消息，描述符按 TCP、Unix 域的顺序经 SCM_RIGHTS 附带
+typedef struct {
+    char magic[8];
+    int32_t has_tcp;
+    int32_t has_unix;
+} upgrade_message_t;
+
+typedef struct h2_connection h2_connection_t;
+
+typedef struct {
+    _Alignas(64) int index;      // 独占缓存行，统计计数不与相邻工作线程伪共享
+    int cpu;                     // 绑定的 CPU，未绑定为 -1
+    pthread_t thread;
+    connection_queue_t* queue;
+    h2_connection_t* h2_slab;    // 线程绑核后首次写入分配，页面落在本地 NUMA 节点
+    atomic_uint_fast64_t connections;
+    atomic_uint_fast64_t busy_ns;
+} worker_context_t;
+
+typedef struct {
+    char path[256];
+    int fd;                      // 多个请求共享，只能用 pread 读取
+    struct stat st;
+    atomic_int refcount;         // 缓存表持有一个引用，每个使用者各持有一个
+    uint64_t last_used;
+    int validate;                // 不在监视范围内（见 file_watcher_should_watch），命中时仍校验 mtime
+} file_cache_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    file_cache_entry_t* slots[FILE_CACHE_SLOTS];
+    uint64_t clock;
+    atomic_int watching;         // 1 表示 inotify 生效，命中无需校验
+} file_cache_t;
+
+typedef struct {
+    char path[256];
+    int is_directory;            // 目录变更使其下所有条目失效
+} invalidation_t;
+
+typedef struct {
+    invalidation_t items[INVALIDATION_QUEUE_SIZE];
+    atomic_size_t head;          // 生产者（inotify 线程）写入位置
+    atomic_size_t tail;          // 消费者（持有缓存锁的线程）读取位置
+    atomic_int overflowed;
+} invalidation_queue_t;
+
+typedef struct {
+    int inotify_fd;
+    int watch_count;
+    int limit_exhausted;
+    char paths[FILE_WATCHER_MAX_WATCHES][256];  // 监视描述符 -> 目录路径
+    ino_t inodes[FILE_WATCHER_MAX_WATCHES];     // 监视描述符 -> 目录 inode（识别移走的目录）
+} file_watcher_t;
+
+typedef struct {
+    char* name;                  // 名称与值共用一次分配
+    size_t name_len;
+    char* value;
+    size_t value_len;
+} hpack_entry_t;
+
+typedef struct {
+    hpack_entry_t entries[HPACK_MAX_ENTRIES];  // 环形缓冲，head 为最新条目
+    size_t head;
+    size_t count;
+    size_t size;
+    size_t max_size;
+} hpack_table_t;
+
+typedef struct {
+    uint32_t id;                 // 0 表示空闲槽位
+    int32_t send_window;
+    int urgency;                 // 0 最紧急，7 最不紧急
+    int remote_closed;
+    int responding;
+    file_cache_entry_t* file;    // 文件响应体，NULL 表示使用 body
+    off_t file_offset;
+    size_t remaining;
+    const char* body;            // 指向 body_storage 或内嵌资源
+    size_t body_offset;
+    request_timing_t timing;     // 本流自己的阶段时间戳，流结束时写入访问日志
+    char body_storage[MAX_BUFFER_SIZE];
+} h2_stream_t;
+
+typedef struct {
+    int static_index;            // 头部名称在 HPACK 静态表中的索引
+    const char* value;
+} h2_header_t;
+
+typedef struct {
+    int status_code;
+    const char* content_type;    // 头部行或头部值
+    const char* body;
+    size_t length;
+    int body_is_static;          // body 在整个响应期间有效，无需拷贝
+    file_cache_entry_t* file;    // 文件响应体，NULL 表示使用 body
+    h2_header_t extra[4];
+    int extra_count;
+} h2_response_t;
+
+struct h2_connection {
+    int fd;
+    uint32_t client_ip;
+    peer_credentials_t peer;
+    int32_t send_window;         // 连接级发送窗口
+    uint32_t peer_initial_window;
+    uint32_t peer_max_frame_size;
+    uint32_t last_stream_id;
+    int peer_goaway;
+    int rr_cursor;
+    hpack_table_t decoder;
+    h2_stream_t streams[H2_MAX_STREAMS];
+    // 正在接收的头部块（HEADERS + CONTINUATION）
+    uint32_t header_stream_id;
+    uint8_t header_flags;
+    size_t header_block_len;
+    uint8_t header_block[H2_HEADER_BLOCK_SIZE];
+    char scratch_name[H2_HEADER_BLOCK_SIZE];
+    char scratch_value[H2_HEADER_BLOCK_SIZE * 2];  // 哈夫曼解码最多膨胀 8/5
+    http_request_t request;
+    size_t recv_len;
+    uint8_t recv_buffer[2 * (H2_FRAME_HEADER_SIZE + H2_MAX_FRAME_SIZE)];
+    uint8_t send_buffer[H2_MAX_FRAME_SIZE];
+};
+
+#if defined(__has_include) && __has_include("example_assets.h")
+#include "example_assets.h"
+#else
+static const embedded_asset_t embedded_assets[1];
+#define EMBEDDED_ASSET_COUNT 0
+#endif
+
 // 全局变量
 static int server_socket = -1;
+static int unix_server_socket = -1;
+static char unix_socket_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
 static volatile int server_running = 1;
 static client_info_t clients[MAX_CLIENTS];
 static int client_count = 0;
+static time_t server_start_time = 0;
+static rate_limit_shard_t rate_limit_shards[RATE_LIMIT_SHARDS] = {
+    [0 ... RATE_LIMIT_SHARDS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+static connection_queue_t connection_queues[MAX_WORKERS] = {
+    [0 ... MAX_WORKERS - 1] = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .not_empty = PTHREAD_COND_INITIALIZER,
+        .interval_min_sojourn_ns = INT64_MAX,
+    }
+};
+static int connection_queue_count = 1;      // 未绑核时所有工作线程共享一个队列
+static worker_context_t workers[MAX_WORKERS];
+static int worker_count = WORKER_COUNT;
+static int pin_workers = 0;
+static int cpu_to_worker[CPU_SETSIZE];      // 收包 CPU -> 工作线程，-1 表示无对应
+static unsigned int dispatch_cursor = 0;
+static int64_t workers_started_ns = 0;
+static volatile sig_atomic_t worker_report_requested = 0;
+static volatile sig_atomic_t upgrade_requested = 0;
+static atomic_int connections_in_flight;    // 已交给工作线程但尚未关闭的连接
+#ifndef LITHE_NO_MAIN
+static char* const* saved_argv = NULL;      // 升级时原样传给新进程
+static char exec_path[PATH_MAX];
+static int upgrade_channel = -1;            // 等待新进程就绪期间的移交通道
+static pid_t upgrade_pid = 0;
+static int64_t upgrade_deadline_ns = 0;
+static int drain_seconds = UPGRADE_DRAIN_SECONDS;
+static sigset_t main_wait_mask;             // 主线程只在 ppoll 等待期间接收信号
+#endif
+static __thread worker_context_t* current_worker = NULL;
+static __thread request_timing_t* current_timing = NULL;
+static int64_t slow_request_threshold_ns = SLOW_REQUEST_THRESHOLD_MS * 1000000LL;
+static atomic_uint_fast64_t slow_request_count;
+static io_buffer_pool_t io_buffer_pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static pthread_once_t io_buffer_pool_once = PTHREAD_ONCE_INIT;
+static __thread io_buffer_cache_t io_buffer_cache;
+static upstream_pool_t upstream_pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static api_cache_t api_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .filled = PTHREAD_COND_INITIALIZER,
+};
+static int64_t api_cache_ttl_ns = API_CACHE_TTL_MS * 1000000LL;
+static access_log_t access_log = {
+    .fd = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .flush_needed = PTHREAD_COND_INITIALIZER,
+};
+static file_cache_t file_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static invalidation_queue_t invalidation_queue;
+static file_watcher_t file_watcher = { .inotify_fd = -1 };
+
+// 日志级别：低于该级别的日志不输出（基准测试时调高以静默日志）
+enum { LOG_LEVEL_DEBUG = 0, LOG_LEVEL_INFO, LOG_LEVEL_WARN, LOG_LEVEL_ERROR, LOG_LEVEL_NONE };
+static int log_min_level = LOG_LEVEL_INFO;
 
 // 函数声明
 int create_server_socket(int port);
-void handle_client_connection(int client_socket, struct sockaddr_in* client_addr);
+int create_unix_server_socket(const char* path, int mode);
+void handle_client_connection(int client_socket, struct sockaddr_in* client_addr, const peer_credentials_t* peer);
 int parse_http_request(const char* raw_request, http_request_t* request);
 void build_http_response(http_response_t* response, int status_code, 
                         const char* content_type, const char* body);
 void send_http_response(int client_socket, const http_response_t* response);
 void serve_static_file(int client_socket, const char* file_path);
 void handle_api_request(int client_socket, const http_request_t* request);
+int upstream_configure(const char* spec);
+void proxy_api_request(int client_socket, const http_request_t* request, const char* client_ip,
+                       char* buffer, size_t received);
+void build_api_response(const http_request_t* request, http_response_t* response);
+void build_api_response_cached(const http_request_t* request, http_response_t* response);
+file_cache_entry_t* open_static_file(const char* file_path, char* local_path, size_t local_path_size, int* status);
+file_cache_entry_t* file_cache_acquire(const char* local_path, int* status);
+void file_cache_release(file_cache_entry_t* entry);
+int lithe_open_file(const char* url_path, lithe_file_t* file);
+void lithe_close_file(lithe_file_t* file);
+int start_file_watcher(const char* root);
 void cleanup_and_exit(int signal);
 void log_message(const char* level, const char* format, ...);
+int access_log_open(const char* path);
+void access_log_record(const request_timing_t* timing, uint32_t client_ip);
+void access_log_flush(void);
+static int64_t monotonic_ns(void);
+int rate_limit_acquire_connection(uint32_t ip);
+void rate_limit_release_connection(uint32_t ip);
+int rate_limit_take_token(uint32_t ip, int* retry_after);
+void send_too_many_requests(int client_socket, int retry_after);
+int connection_queue_push(connection_queue_t* queue, const pending_connection_t* conn);
+int connection_queue_pop(connection_queue_t* queue, pending_connection_t* conn, int* admitted);
+void send_service_unavailable(int client_socket);
+int start_workers(void);
+int dispatch_connection(const pending_connection_t* conn);
+void report_worker_load(void);
+char* io_buffer_get(void);
+void io_buffer_put(char* buffer);
+int io_buffer_pool_iovecs(struct iovec* iov, int max);
+int find_request_header(const http_request_t* request, const char* name, char* value, size_t value_size);
+const embedded_asset_t* find_embedded_asset(const char* path);
+int choose_asset_encoding(const embedded_asset_t* asset, const http_request_t* request);
+int asset_not_modified(const embedded_asset_t* asset, const http_request_t* request);
+int serve_embedded_asset(int client_socket, const http_request_t* request);
+void h2_serve_connection(int client_socket, uint32_t client_ip, const peer_credentials_t* peer,
+                         const char* initial, size_t initial_len, const http_request_t* upgraded_request);
 
 /**
  * 创建服务器套接字
@@ -119,29 +644,179 @@ int create_server_socket(int port) {
 }
 
 /**
- * 处理客户端连接
+ * 创建 Unix 域监听套接字，供本机反向代理直连，省去回环 TCP 的开销
+ * @param path 套接字路径；以 @ 开头表示抽象命名空间（不落盘，不受文件权限约束）
+ * @param mode 文件权限（如 0660），负数表示沿用 umask
+ * @return 服务器套接字文件描述符，失败返回-1
+ */
+int create_unix_server_socket(const char* path, int mode) {
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    size_t path_len = strlen(path);
+    int abstract = path[0] == '@';
+    struct stat st;
+    int sockfd;
+
+    if (path_len == 0 || path_len >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Invalid unix socket path: %s\n", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, path_len);
+    addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path_len);
+    if (abstract) {
+        addr.sun_path[0] = '\0';
+    } else {
+        addr_len += 1;
+        // 清理上次运行残留的套接字文件，其他类型的文件不动
+        if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(path);
+        }
+    }
+
+    sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        perror("unix socket creation failed");
+        return -1;
+    }
+    if (bind(sockfd, (struct sockaddr*)&addr, addr_len) < 0) {
+        perror("unix socket bind failed");
+        close(sockfd);
+        return -1;
+    }
+    if (!abstract) {
+        snprintf(unix_socket_path, sizeof(unix_socket_path), "%s", path);
+        if (mode >= 0 && chmod(path, (mode_t)mode) < 0) {
+            perror("unix socket chmod failed");
+            close(sockfd);
+            unlink(path);
+            return -1;
+        }
+    }
+    if (listen(sockfd, BACKLOG) < 0) {
+        perror("unix socket listen failed");
+        close(sockfd);
+        return -1;
+    }
+
+    log_message("INFO", "Server listening on unix:%s", path);
+    return sockfd;
+}
+
+/**
+ * 记录请求解析完成的时间与访问日志需要的请求字段
+ */
+static void timing_set_request(request_timing_t* timing, const http_request_t* request) {
+    size_t len = strnlen(request->path, sizeof(timing->path) - 1);
+
+    timing->parsed_ns = monotonic_ns();
+    memcpy(timing->path, request->path, len);
+    timing->path[len] = '\0';
+    memcpy(timing->method, request->method, sizeof(timing->method));
+    if (find_request_header(request, "User-Agent", timing->user_agent, sizeof(timing->user_agent)) != 0) {
+        timing->user_agent[0] = '\0';
+    }
+}
+
+/**
+ * 阶段打点：只记录连接上第一次到达该阶段的时间（HTTP/2 连接上的后续请求不覆盖，
+ * 各流另有自己的时间戳）；不在工作线程中（没有 current_timing）时只触发探针
+ */
+static void trace_request_parsed(int client_socket, const http_request_t* request) {
+    LITHE_PROBE2(request_parsed, client_socket, request->path);
+    if (current_timing && current_timing->parsed_ns == 0) {
+        timing_set_request(current_timing, request);
+    }
+}
+
+static void trace_handler_start(int client_socket, const char* path) {
+    LITHE_PROBE2(handler_start, client_socket, path);
+    if (current_timing && current_timing->handler_ns == 0) {
+        current_timing->handler_ns = monotonic_ns();
+    }
+}
+
+static void trace_first_byte(int client_socket, int status, uint64_t bytes) {
+    if (current_timing && current_timing->first_byte_ns == 0) {
+        current_timing->first_byte_ns = monotonic_ns();
+        current_timing->status = status;
+        current_timing->bytes = bytes;
+        LITHE_PROBE2(first_byte, client_socket, current_timing->first_byte_ns - current_timing->accept_ns);
+    }
+}
+
+/**
+ * 慢请求采样日志：总耗时超过阈值的连接每 SLOW_REQUEST_SAMPLE_RATE 个记录一个，
+ * 按排队、接收解析、处理、发送四个阶段拆分耗时；缺失的阶段按零耗时计
+ */
+static void log_slow_request(const request_timing_t* timing, const char* client) {
+    int64_t total = timing->complete_ns - timing->accept_ns;
+
+    if (slow_request_threshold_ns < 0 || total < slow_request_threshold_ns) {
+        return;
+    }
+    if (atomic_fetch_add_explicit(&slow_request_count, 1, memory_order_relaxed) % SLOW_REQUEST_SAMPLE_RATE != 0) {
+        return;
+    }
+
+    int64_t dequeued = timing->dequeue_ns ? timing->dequeue_ns : timing->accept_ns;
+    int64_t parsed = timing->parsed_ns ? timing->parsed_ns : dequeued;
+    int64_t first_byte = timing->first_byte_ns ? timing->first_byte_ns : parsed;
+
+    log_message("WARN", "Slow request %s from %s: total %.1fms = queue %.1fms + parse %.1fms "
+                "+ handler %.1fms + send %.1fms",
+                timing->path[0] ? timing->path : "-", client, total / 1e6,
+                (dequeued - timing->accept_ns) / 1e6, (parsed - dequeued) / 1e6,
+                (first_byte - parsed) / 1e6, (timing->complete_ns - first_byte) / 1e6);
+}
+
+/**
+ * 生成日志中的客户端描述：TCP 为 IP:端口，Unix 域为对端进程凭据
+ */
+static void describe_client(const struct sockaddr_in* client_addr, const peer_credentials_t* peer,
+                            char* out, size_t out_size) {
+    char client_ip[INET_ADDRSTRLEN];
+
+    if (peer->valid) {
+        snprintf(out, out_size, "unix(pid=%d,uid=%d,gid=%d)", (int)peer->pid, (int)peer->uid, (int)peer->gid);
+        return;
+    }
+    inet_ntop(AF_INET, &client_addr->sin_addr, client_ip, sizeof(client_ip));
+    snprintf(out, out_size, "%s:%d", client_ip, ntohs(client_addr->sin_port));
+}
+
+/**
+ * 在给定的接收缓冲区上读取并处理客户端请求（不关闭连接）
+ * Unix 域连接来自本机代理，不参与按 IP 限流
  * @param client_socket 客户端套接字
  * @param client_addr 客户端地址信息
+ * @param peer 对端凭据
+ * @param client 客户端描述（用于日志）
+ * @param buffer 接收缓冲区
+ * @param buffer_size 缓冲区大小
  */
-void handle_client_connection(int client_socket, struct sockaddr_in* client_addr) {
-    char buffer[MAX_BUFFER_SIZE];
+static void handle_client_request(int client_socket, struct sockaddr_in* client_addr,
+                                  const peer_credentials_t* peer, const char* client,
+                                  char* buffer, size_t buffer_size) {
     http_request_t request;
     ssize_t bytes_received;
     
-    // 获取客户端IP地址
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &(client_addr->sin_addr), client_ip, INET_ADDRSTRLEN);
-    
-    log_message("INFO", "New connection from %s:%d", 
-                client_ip, ntohs(client_addr->sin_port));
+    log_message("INFO", "New connection from %s", client);
     
     // 接收HTTP请求
-    memset(buffer, 0, sizeof(buffer));
-    bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+    bytes_received = recv(client_socket, buffer, buffer_size - 1, 0);
     
     if (bytes_received <= 0) {
         log_message("ERROR", "Failed to receive data from client");
-        close(client_socket);
+        return;
+    }
+    
+    // HTTP/2 先验知识：连接以 h2 序言开头
+    size_t preface_len = bytes_received < H2_PREFACE_LEN ? (size_t)bytes_received : H2_PREFACE_LEN;
+    if (bytes_received >= 3 && memcmp(buffer, H2_PREFACE, preface_len) == 0) {
+        h2_serve_connection(client_socket, client_addr->sin_addr.s_addr, peer, buffer, bytes_received, NULL);
         return;
     }
     
@@ -151,18 +826,81 @@ void handle_client_connection(int client_socket, struct sockaddr_in* client_addr
     // 解析HTTP请求
     if (parse_http_request(buffer, &request) != 0) {
         log_message("ERROR", "Failed to parse HTTP request");
-        close(client_socket);
+        return;
+    }
+    request.peer = *peer;
+    trace_request_parsed(client_socket, &request);
+    
+    // 按客户端 IP 消耗请求令牌
+    int retry_after = 1;
+    if (!peer->valid && rate_limit_take_token(client_addr->sin_addr.s_addr, &retry_after) != 0) {
+        log_message("WARN", "Rate limited %s, retry after %ds", client, retry_after);
+        send_too_many_requests(client_socket, retry_after);
+        return;
+    }
+    
+    // h2c 升级：升级请求本身作为流 1 在 HTTP/2 上响应
+    // 带请求体的升级按 HTTP/1.1 处理（RFC 7540 允许忽略 Upgrade），否则请求体会被当作连接序言
+    char upgrade[16];
+    char http2_settings[128];
+    char body_header[32];
+    int has_body = find_request_header(&request, "Transfer-Encoding", body_header, sizeof(body_header)) == 0 ||
+                   (find_request_header(&request, "Content-Length", body_header, sizeof(body_header)) == 0 &&
+                    strtoull(body_header, NULL, 10) != 0);
+    if (!has_body &&
+        find_request_header(&request, "Upgrade", upgrade, sizeof(upgrade)) == 0 &&
+        strcasecmp(upgrade, "h2c") == 0 &&
+        find_request_header(&request, "HTTP2-Settings", http2_settings, sizeof(http2_settings)) == 0) {
+        const char* rest = strstr(buffer, "\r\n\r\n");
+        rest = rest ? rest + 4 : buffer + bytes_received;
+        h2_serve_connection(client_socket, client_addr->sin_addr.s_addr, peer, rest,
+                            (size_t)(buffer + bytes_received - rest), &request);
         return;
     }
     
-    // 路由处理
-    if (strncmp(request.path, "/api/", 5) == 0) {
+    // 路由处理：API（配置了上游时转发）、内嵌资源，最后才访问文件系统
+    trace_handler_start(client_socket, request.path);
+    if (strncmp(request.path, "/api/", 5) == 0 && upstream_pool.configured) {
+        char forwarded_for[INET_ADDRSTRLEN] = "127.0.0.1";
+        if (!peer->valid) {
+            inet_ntop(AF_INET, &client_addr->sin_addr, forwarded_for, sizeof(forwarded_for));
+        }
+        proxy_api_request(client_socket, &request, forwarded_for, buffer, (size_t)bytes_received);
+    } else if (strncmp(request.path, "/api/", 5) == 0) {
         handle_api_request(client_socket, &request);
-    } else {
+    } else if (serve_embedded_asset(client_socket, &request) != 0) {
         serve_static_file(client_socket, request.path);
     }
-    
+}
+
+/**
+ * 处理客户端连接：从缓冲区池借出接收缓冲区，处理完毕后归还并关闭连接
+ * @param client_socket 客户端套接字
+ * @param client_addr 客户端地址信息
+ * @param peer 对端凭据（Unix 域连接）
+ */
+void handle_client_connection(int client_socket, struct sockaddr_in* client_addr, const peer_credentials_t* peer) {
+    char* buffer = io_buffer_get();
+    char client[64];
+
+    describe_client(client_addr, peer, client, sizeof(client));
+    if (buffer) {
+        handle_client_request(client_socket, client_addr, peer, client, buffer, IO_BUFFER_SIZE);
+        io_buffer_put(buffer);
+    } else {
+        log_message("ERROR", "Out of I/O buffers");
+    }
+
+    if (current_timing) {
+        current_timing->complete_ns = monotonic_ns();
+        LITHE_PROBE2(response_complete, client_socket, current_timing->complete_ns - current_timing->accept_ns);
+    }
     close(client_socket);
+    LITHE_PROBE1(close, client_socket);
+    if (current_timing && !current_timing->multiplexed) {
+        log_slow_request(current_timing, client);
+        access_log_record(current_timing, peer->valid ? 0 : client_addr->sin_addr.s_addr);
+    }
 }
 
 /**
@@ -241,12 +979,20 @@ void build_http_response(http_response_t* response, int status_code,
     // 设置状态消息
     switch (status_code) {
         case 200: status_message = "OK"; break;
+        case 400: status_message = "Bad Request"; break;
+        case 403: status_message = "Forbidden"; break;
         case 404: status_message = "Not Found"; break;
+        case 414: status_message = "URI Too Long"; break;
+        case 429: status_message = "Too Many Requests"; break;
         case 500: status_message = "Internal Server Error"; break;
+        case 502: status_message = "Bad Gateway"; break;
+        case 503: status_message = "Service Unavailable"; break;
+        case 504: status_message = "Gateway Timeout"; break;
         default: status_message = "Unknown"; break;
     }
     
     response->status_code = status_code;
+    response->content_type = content_type;
     strcpy(response->status_message, status_message);
     
     // 构建响应头
@@ -281,6 +1027,7 @@ void send_http_response(int client_socket, const http_response_t* response) {
         log_message("ERROR", "Failed to send response headers");
         return;
     }
+    trace_first_byte(client_socket, response->status_code, response->content_length);
     
     // 发送响应体
     if (response->content_length > 0) {
@@ -298,73 +1045,4346 @@ void send_http_response(int client_socket, const http_response_t* response) {
 }
 
 /**
- * 主函数
+ * 根据文件扩展名推断内容类型
+ * @param file_path 文件路径
+ * @return 完整的 Content-Type 头部行（不含 CRLF）
  */
-int main(int argc, char* argv[]) {
-    int port = DEFAULT_PORT;
-    struct sockaddr_in client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
-    int client_socket;
-    
-    // 解析命令行参数
-    if (argc > 1) {
-        port = atoi(argv[1]);
-        if (port <= 0 || port > 65535) {
-            fprintf(stderr, "Invalid port number: %s\n", argv[1]);
-            return EXIT_FAILURE;
+static const char* guess_content_type(const char* file_path) {
+    const char* ext = strrchr(file_path, '.');
+
+    if (!ext) return "Content-Type: application/octet-stream";
+    if (strcmp(ext, ".html") == 0 || strcmp(ext, ".htm") == 0) return "Content-Type: text/html; charset=utf-8";
+    if (strcmp(ext, ".css") == 0) return "Content-Type: text/css; charset=utf-8";
+    if (strcmp(ext, ".js") == 0) return "Content-Type: application/javascript";
+    if (strcmp(ext, ".json") == 0) return "Content-Type: application/json";
+    if (strcmp(ext, ".png") == 0) return "Content-Type: image/png";
+    if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0) return "Content-Type: image/jpeg";
+    if (strcmp(ext, ".ico") == 0) return "Content-Type: image/x-icon";
+    if (strcmp(ext, ".txt") == 0 || strcmp(ext, ".c") == 0 || strcmp(ext, ".md") == 0) return "Content-Type: text/plain; charset=utf-8";
+    return "Content-Type: application/octet-stream";
+}
+
+/**
+ * 发送一个简单的错误响应
+ * @param client_socket 客户端套接字
+ * @param status_code 状态码
+ */
+static void send_error_response(int client_socket, int status_code) {
+    http_response_t response;
+    char body[128];
+
+    snprintf(body, sizeof(body), "<h1>%d</h1>", status_code);
+    build_http_response(&response, status_code, CONTENT_TYPE_HTML_LINE, body);
+    send_http_response(client_socket, &response);
+}
+
+/**
+ * 将请求路径解析为本地文件，经文件缓存打开
+ * @param file_path 请求路径（以 / 开头）
+ * @param local_path 输出本地路径
+ * @param local_path_size local_path 缓冲区大小
+ * @param status 失败时写入 HTTP 状态码
+ * @return 成功返回缓存条目（用完调用 file_cache_release），失败返回 NULL
+ */
+file_cache_entry_t* open_static_file(const char* file_path, char* local_path, size_t local_path_size, int* status) {
+    // 防止目录遍历攻击
+    if (strstr(file_path, "..") != NULL) {
+        *status = 403;
+        return NULL;
+    }
+
+    // 去掉查询字符串并折叠空段与 "." 段，使缓存键与 inotify 失效路径（"./a/b"）一致
+    size_t path_len = strcspn(file_path, "?#");
+    size_t used = 1;
+    local_path[0] = '.';
+    for (size_t i = 0; i < path_len;) {
+        size_t seg_len;
+        while (i < path_len && file_path[i] == '/') i++;
+        seg_len = strcspn(file_path + i, "/?#");
+        if (seg_len == 0 || (seg_len == 1 && file_path[i] == '.')) {
+            i += seg_len;
+            continue;
+        }
+        if (used + 1 + seg_len >= local_path_size) {
+            *status = 404;
+            return NULL;
         }
+        local_path[used++] = '/';
+        memcpy(local_path + used, file_path + i, seg_len);
+        used += seg_len;
+        i += seg_len;
     }
-    
-    // 设置信号处理
-    signal(SIGINT, cleanup_and_exit);
-    signal(SIGTERM, cleanup_and_exit);
-    
-    // 创建服务器套接字
-    server_socket = create_server_socket(port);
-    if (server_socket < 0) {
-        fprintf(stderr, "Failed to create server socket\n");
-        return EXIT_FAILURE;
+    local_path[used] = '\0';
+
+    // "/" 映射到 index.html
+    if (used == 1) {
+        snprintf(local_path, local_path_size, "./index.html");
     }
-    
-    printf("🚀 LitheServer started successfully!\n");
-    printf("📁 Serving files from current directory\n");
-    printf("🌐 Server listening on http://localhost:%d\n", port);
-    printf("💡 Press Ctrl+C to stop the server\n\n");
-    
-    // 主循环：接受客户端连接
-    while (server_running) {
-        client_socket = accept(server_socket, 
-                              (struct sockaddr*)&client_addr, 
-                              &client_addr_len);
-        
-        if (client_socket < 0) {
-            if (errno == EINTR) {
-                continue;  // 被信号中断，继续循环
-            }
-            perror("accept failed");
+
+    return file_cache_acquire(local_path, status);
+}
+
+/**
+ * 提供静态文件
+ * @param client_socket 客户端套接字
+ * @param file_path 请求路径（以 / 开头）
+ */
+void serve_static_file(int client_socket, const char* file_path) {
+    char* buffer;
+    char local_path[512];
+    char headers[MAX_BUFFER_SIZE];
+    file_cache_entry_t* file;
+    ssize_t bytes_read;
+    off_t offset = 0;
+    int status;
+
+    file = open_static_file(file_path, local_path, sizeof(local_path), &status);
+    if (!file) {
+        send_error_response(client_socket, status);
+        return;
+    }
+
+    snprintf(headers, sizeof(headers),
+             "HTTP/1.1 200 OK\r\n"
+             "%s\r\n"
+             "Content-Length: %lld\r\n"
+             "Connection: close\r\n"
+             "Server: LitheServer/1.0\r\n"
+             "\r\n",
+             guess_content_type(local_path), (long long)file->st.st_size);
+
+    if (send(client_socket, headers, strlen(headers), 0) < 0) {
+        log_message("ERROR", "Failed to send file headers");
+        file_cache_release(file);
+        return;
+    }
+    trace_first_byte(client_socket, 200, (uint64_t)file->st.st_size);
+
+    buffer = io_buffer_get();
+    if (!buffer) {
+        log_message("ERROR", "Out of I/O buffers");
+        file_cache_release(file);
+        return;
+    }
+
+    // 描述符在请求间共享，按偏移读取
+    while (offset < file->st.st_size &&
+           (bytes_read = pread(file->fd, buffer, IO_BUFFER_SIZE, offset)) > 0) {
+        if (send(client_socket, buffer, bytes_read, 0) < 0) {
+            log_message("ERROR", "Failed to send file body");
             break;
         }
-        
-        // 处理客户端连接（简化版，实际项目中应该使用多线程或异步处理）
-        handle_client_connection(client_socket, &client_addr);
+        offset += bytes_read;
     }
-    
-    cleanup_and_exit(0);
-    return EXIT_SUCCESS;
+
+    io_buffer_put(buffer);
+    file_cache_release(file);
+    log_message("INFO", "Served file %s (%lld bytes)", local_path, (long long)offset);
 }
 
 /**
- * 清理并退出
- * @param signal 信号值
+ * 按 URL 路径打开静态文件（经文件描述符缓存），供 C++ 协程层发送
+ * @param url_path 请求路径（以 / 开头，可带查询串）
+ * @param file 输出文件句柄，使用完毕后调用 lithe_close_file
+ * @return 成功返回0，失败返回 HTTP 状态码
  */
-void cleanup_and_exit(int signal) {
-    server_running = 0;
-    
-    if (server_socket >= 0) {
-        close(server_socket);
-        server_socket = -1;
+int lithe_open_file(const char* url_path, lithe_file_t* file) {
+    char local_path[512];
+    int status = 404;
+    file_cache_entry_t* entry = open_static_file(url_path, local_path, sizeof(local_path), &status);
+
+    if (!entry) {
+        return status;
+    }
+    file->fd = entry->fd;
+    file->size = (uint64_t)entry->st.st_size;
+    file->content_type = guess_content_type(local_path);
+    file->handle = entry;
+    return 0;
+}
+
+void lithe_close_file(lithe_file_t* file) {
+    file_cache_release(file->handle);
+    file->handle = NULL;
+}
+
+/**
+ * 判断请求目标的路径部分（不含查询串）是否为给定路径
+ */
+static int api_path_is(const char* target, const char* path) {
+    size_t len = strlen(path);
+    return strncmp(target, path, len) == 0 && (target[len] == '\0' || target[len] == '?');
+}
+
+/**
+ * 生成 API 响应（与传输协议无关，HTTP/1.1 与 HTTP/2 共用）
+ * @param request 已解析的请求
+ * @param response 输出响应
+ */
+void build_api_response(const http_request_t* request, http_response_t* response) {
+    char body[MAX_BUFFER_SIZE];
+
+    if (api_path_is(request->path, "/api/status")) {
+        int len = snprintf(body, sizeof(body),
+                           "{\"status\":\"ok\",\"server\":\"LitheServer/1.0\",\"uptime\":%ld",
+                           (long)(time(NULL) - server_start_time));
+        // 经 Unix 域套接字访问时附带对端凭据，便于代理侧核对身份
+        if (request->peer.valid) {
+            len += snprintf(body + len, sizeof(body) - len, ",\"peer\":{\"pid\":%d,\"uid\":%d,\"gid\":%d}",
+                            (int)request->peer.pid, (int)request->peer.uid, (int)request->peer.gid);
+        }
+        snprintf(body + len, sizeof(body) - len, "}");
+        build_http_response(response, 200, CONTENT_TYPE_JSON_LINE, body);
+    } else if (api_path_is(request->path, "/api/list")) {
+        DIR* dir = opendir(".");
+        struct dirent* entry;
+        size_t len = 0;
+
+        if (!dir) {
+            build_http_response(response, 500, CONTENT_TYPE_JSON_LINE, "{\"error\":\"opendir failed\"}");
+            return;
+        }
+
+        // 列出当前目录，超出缓冲区的条目被截断
+        len += snprintf(body + len, sizeof(body) - len, "{\"entries\":[");
+        while ((entry = readdir(dir)) != NULL) {
+            size_t name_len = strlen(entry->d_name);
+            if (entry->d_name[0] == '.' || strpbrk(entry->d_name, "\"\\") != NULL) {
+                continue;
+            }
+            if (len + name_len + 8 >= sizeof(body)) {
+                break;
+            }
+            len += snprintf(body + len, sizeof(body) - len, "%s\"%s\"",
+                            body[len - 1] == '[' ? "" : ",", entry->d_name);
+        }
+        closedir(dir);
+        snprintf(body + len, sizeof(body) - len, "]}");
+        build_http_response(response, 200, CONTENT_TYPE_JSON_LINE, body);
+    } else {
+        build_http_response(response, 404, CONTENT_TYPE_JSON_LINE, "{\"error\":\"not found\"}");
+    }
+}
+
+/**
+ * 处理 API 请求
+ * @param client_socket 客户端套接字
+ * @param request 已解析的请求
+ */
+void handle_api_request(int client_socket, const http_request_t* request) {
+    http_response_t response;
+
+    build_api_response_cached(request, &response);
+    send_http_response(client_socket, &response);
+}
+
+// ---------- API 微缓存 ----------
+//
+// 只读且代价与请求者无关的 GET 接口（目录列表）按规范化的路径 + 查询串缓存一小段时间；
+// 同一键正在生成时，后来的请求等待其结果而不是各自计算（singleflight）。
+// /api/status 含运行时长与对端凭据，不缓存。
+
+static const char* const api_cacheable_paths[] = { "/api/list" };
+
+static int compare_query_params(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/**
+ * 规范化请求目标作为缓存键：合并重复斜杠、去掉末尾斜杠，查询参数按字典序排列
+ * @param target 请求目标（路径 + 可选查询串）
+ * @param out 输出缓冲区
+ * @param out_size 缓冲区大小
+ * @return 成功返回0，键过长或查询参数过多返回-1（不缓存）
+ */
+static int api_cache_normalize(const char* target, char* out, size_t out_size) {
+    char query[256];
+    char* params[API_CACHE_MAX_QUERY_PARAMS];
+    int param_count = 0;
+    size_t len = 0;
+    const char* p;
+
+    for (p = target; *p && *p != '?'; ++p) {
+        if (*p == '/' && len > 0 && out[len - 1] == '/') {
+            continue;
+        }
+        if (len + 1 >= out_size) {
+            return -1;
+        }
+        out[len++] = *p;
+    }
+    if (len > 1 && out[len - 1] == '/') {
+        --len;
+    }
+    out[len] = '\0';
+    if (*p != '?') {
+        return 0;
+    }
+
+    if (strlen(p + 1) >= sizeof(query)) {
+        return -1;
+    }
+    strcpy(query, p + 1);
+    char* saveptr;
+    for (char* param = strtok_r(query, "&", &saveptr); param; param = strtok_r(NULL, "&", &saveptr)) {
+        if (param_count == API_CACHE_MAX_QUERY_PARAMS) {
+            return -1;
+        }
+        params[param_count++] = param;
+    }
+    qsort(params, param_count, sizeof(params[0]), compare_query_params);
+    for (int i = 0; i < param_count; ++i) {
+        int written = snprintf(out + len, out_size - len, "%c%s", i == 0 ? '?' : '&', params[i]);
+        if (written < 0 || (size_t)written >= out_size - len) {
+            return -1;
+        }
+        len += (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * 判断请求是否可缓存；key 为规范化后的目标，避免 /api//list/ 之类的写法绕过缓存
+ */
+static int api_cacheable(const http_request_t* request, const char* key) {
+    if (api_cache_ttl_ns <= 0 || (strcmp(request->method, "GET") != 0 && strcmp(request->method, "HEAD") != 0)) {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(api_cacheable_paths) / sizeof(api_cacheable_paths[0]); ++i) {
+        if (api_path_is(key, api_cacheable_paths[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 在探测窗口内查找键；未找到时给出可复用的槽位（空槽优先，其次是最久未用且不在生成中的条目）
+ * 调用者须持有 api_cache.lock
+ */
+static api_cache_entry_t* api_cache_lookup_locked(const char* key, uint64_t hash, api_cache_entry_t** victim) {
+    *victim = NULL;
+    for (int i = 0; i < API_CACHE_PROBE_WINDOW; ++i) {
+        api_cache_entry_t* entry = &api_cache.slots[(hash + i) & (API_CACHE_SLOTS - 1)];
+
+        if (entry->state == API_CACHE_EMPTY) {
+            if (!*victim || (*victim)->state != API_CACHE_EMPTY) {
+                *victim = entry;
+            }
+            continue;
+        }
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+        if (entry->state == API_CACHE_READY &&
+            (!*victim || ((*victim)->state != API_CACHE_EMPTY && entry->last_used < (*victim)->last_used))) {
+            *victim = entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 生成 API 响应，可缓存的接口先查微缓存
+ * 未命中时由第一个请求计算，同一键的其余请求等待并共享其结果；只缓存 200 响应
+ * @param request 已解析的请求
+ * @param response 输出响应
+ */
+void build_api_response_cached(const http_request_t* request, http_response_t* response) {
+    http_request_t normalized;
+    api_cache_entry_t* entry;
+    api_cache_entry_t* victim;
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t generation;
+    int waited = 0;
+
+    if (api_cache_ttl_ns <= 0 || api_cache_normalize(request->path, normalized.path, sizeof(normalized.path)) != 0 ||
+        !api_cacheable(request, normalized.path)) {
+        build_api_response(request, response);
+        return;
+    }
+    for (const char* p = normalized.path; *p; ++p) {
+        hash = (hash ^ (uint8_t)*p) * 1099511628211ULL;
+    }
+
+    pthread_mutex_lock(&api_cache.lock);
+    for (;;) {
+        entry = api_cache_lookup_locked(normalized.path, hash, &victim);
+        if (!entry || entry->state != API_CACHE_FILLING) {
+            break;
+        }
+        if (!waited) {
+            waited = 1;
+            atomic_fetch_add_explicit(&api_cache.coalesced, 1, memory_order_relaxed);
+        }
+        pthread_cond_wait(&api_cache.filled, &api_cache.lock);
+    }
+
+    generation = atomic_load(&api_cache.generation);
+    if (entry && entry->state == API_CACHE_READY &&
+        entry->expires_ns > monotonic_ns() && entry->generation == generation) {
+        *response = entry->response;
+        entry->last_used = ++api_cache.clock;
+        pthread_mutex_unlock(&api_cache.lock);
+        atomic_fetch_add_explicit(&api_cache.hits, 1, memory_order_relaxed);
+        return;
+    }
+
+    // 未命中：占住槽位后在锁外计算；探测窗口内全部在生成中时直接计算不缓存
+    atomic_fetch_add_explicit(&api_cache.misses, 1, memory_order_relaxed);
+    if (!entry) {
+        entry = victim;
+    }
+    if (!entry) {
+        pthread_mutex_unlock(&api_cache.lock);
+        build_api_response(request, response);
+        return;
+    }
+    strcpy(entry->key, normalized.path);
+    entry->hash = hash;
+    entry->state = API_CACHE_FILLING;
+    pthread_mutex_unlock(&api_cache.lock);
+
+    // 按规范化后的目标生成，保证同一键下缓存的内容与其路由一致
+    memcpy(normalized.method, request->method, sizeof(normalized.method));
+    memcpy(normalized.version, request->version, sizeof(normalized.version));
+    memcpy(normalized.headers, request->headers, sizeof(normalized.headers));
+    normalized.body[0] = '\0';
+    normalized.peer = request->peer;
+    build_api_response(&normalized, response);
+
+    pthread_mutex_lock(&api_cache.lock);
+    if (response->status_code == 200) {
+        entry->response = *response;
+        entry->expires_ns = monotonic_ns() + api_cache_ttl_ns;
+        entry->generation = generation;
+        entry->last_used = ++api_cache.clock;
+        entry->state = API_CACHE_READY;
+    } else {
+        entry->state = API_CACHE_EMPTY;
+    }
+    pthread_cond_broadcast(&api_cache.filled);
+    pthread_mutex_unlock(&api_cache.lock);
+}
+
+static int compare_asset_path(const void* key, const void* element) {
+    return strcmp((const char*)key, ((const embedded_asset_t*)element)->path);
+}
+
+/**
+ * 查找内嵌资源（表按路径排序，二分查找）
+ * @param path 请求路径，可带查询字符串
+ * @return 找到返回资源指针，否则返回 NULL
+ */
+const embedded_asset_t* find_embedded_asset(const char* path) {
+    char key[256];
+
+    if (EMBEDDED_ASSET_COUNT == 0) {
+        return NULL;
+    }
+    snprintf(key, sizeof(key), "%s", path);
+    key[strcspn(key, "?#")] = '\0';
+    return bsearch(key, embedded_assets, EMBEDDED_ASSET_COUNT, sizeof(embedded_asset_t), compare_asset_path);
+}
+
+/**
+ * 取 Accept-Encoding 中某个编码的 q 值；未列出时退回 "*" 的 q 值
+ * @param header Accept-Encoding 头部值
+ * @param coding 编码名
+ * @return q 值的千分数（0~1000），既未列出也没有 "*" 时返回-1
+ */
+static int accept_encoding_quality(const char* header, const char* coding) {
+    size_t coding_len = strlen(coding);
+    int wildcard = -1;
+    const char* p = header;
+
+    while (*p) {
+        const char* end = p + strcspn(p, ",");
+        const char* name = p + strspn(p, " \t");
+        size_t name_len = strcspn(name, ";, \t");
+        const char* param = memchr(name, ';', (size_t)(end - name));
+        int quality = 1000;
+
+        if (name + name_len > end) {
+            name_len = (size_t)(end - name);
+        }
+        // 只认 q 参数，形如 q=0.8；小数点后最多三位
+        while (param && param < end) {
+            param += strspn(param + 1, " \t") + 1;
+            if ((param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                const char* digit = param + 2;
+                int scale = 1000;
+
+                quality = 0;
+                if (*digit == '1' || *digit == '0') {
+                    quality = (*digit++ - '0') * 1000;
+                }
+                if (*digit == '.') {
+                    while (++digit < end && *digit >= '0' && *digit <= '9' && scale > 1) {
+                        scale /= 10;
+                        quality += (*digit - '0') * scale;
+                    }
+                }
+                if (quality > 1000) {
+                    quality = 1000;
+                }
+            }
+            param = memchr(param, ';', (size_t)(end - param));
+        }
+
+        if (name_len == coding_len && strncasecmp(name, coding, coding_len) == 0) {
+            return quality;
+        }
+        if (name_len == 1 && name[0] == '*') {
+            wildcard = quality;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return wildcard;
+}
+
+/**
+ * 根据 Accept-Encoding 选择预压缩版本：取 q 值最高的可用编码，同分时 br 优先，q=0 表示拒绝
+ * @return ASSET_IDENTITY / ASSET_GZIP / ASSET_BROTLI
+ */
+int choose_asset_encoding(const embedded_asset_t* asset, const http_request_t* request) {
+    char accept_encoding[256];
+    int brotli = -1;
+    int gzip = -1;
+
+    if (find_request_header(request, "Accept-Encoding", accept_encoding, sizeof(accept_encoding)) != 0) {
+        return ASSET_IDENTITY;
+    }
+    if (asset->variants[ASSET_BROTLI].body) {
+        brotli = accept_encoding_quality(accept_encoding, "br");
+    }
+    if (asset->variants[ASSET_GZIP].body) {
+        gzip = accept_encoding_quality(accept_encoding, "gzip");
+    }
+    if (brotli > 0 && brotli >= gzip) {
+        return ASSET_BROTLI;
+    }
+    if (gzip > 0) {
+        return ASSET_GZIP;
+    }
+    return ASSET_IDENTITY;
+}
+
+/**
+ * 判断客户端缓存是否仍然有效：If-None-Match 为 "*"，或列表中某个 ETag 与资源 ETag 弱比较相等
+ */
+int asset_not_modified(const embedded_asset_t* asset, const http_request_t* request) {
+    char if_none_match[512];
+    const char* etag = asset->etag;
+    size_t etag_len;
+    const char* p = if_none_match;
+
+    if (find_request_header(request, "If-None-Match", if_none_match, sizeof(if_none_match)) != 0) {
+        return 0;
+    }
+    if (strncmp(etag, "W/", 2) == 0) {
+        etag += 2;
+    }
+    etag_len = strlen(etag);
+
+    // 逐个取出列表项；引号内可以出现逗号，按引号界定
+    for (;;) {
+        const char* start;
+
+        p += strspn(p, " \t,");
+        if (*p == '\0') {
+            return 0;
+        }
+        if (*p == '*') {
+            return 1;
+        }
+        if (strncmp(p, "W/", 2) == 0) {
+            p += 2;
+        }
+        start = p;
+        if (*p == '"') {
+            const char* quote = strchr(p + 1, '"');
+            p = quote ? quote + 1 : p + strlen(p);
+        } else {
+            p += strcspn(p, " \t,");
+        }
+        if ((size_t)(p - start) == etag_len && memcmp(start, etag, etag_len) == 0) {
+            return 1;
+        }
+    }
+}
+
+/**
+ * 提供内嵌静态资源：查表后一次 writev 发出预先序列化的头部与响应体
+ * @param client_socket 客户端套接字
+ * @param request 已解析的请求
+ * @return 已处理返回0，不是内嵌资源返回-1
+ */
+int serve_embedded_asset(int client_socket, const http_request_t* request) {
+    const embedded_asset_t* asset = find_embedded_asset(request->path);
+    const embedded_variant_t* variant;
+    struct iovec iov[2];
+    int iovcnt = 1;
+
+    if (!asset) {
+        return -1;
+    }
+
+    if (asset_not_modified(asset, request)) {
+        send(client_socket, asset->not_modified, asset->not_modified_len, MSG_NOSIGNAL);
+        trace_first_byte(client_socket, 304, 0);
+        return 0;
+    }
+
+    variant = &asset->variants[choose_asset_encoding(asset, request)];
+    iov[0].iov_base = (void*)variant->headers;
+    iov[0].iov_len = variant->headers_len;
+    if (strcmp(request->method, "HEAD") != 0) {
+        iov[1].iov_base = (void*)variant->body;
+        iov[1].iov_len = variant->body_len;
+        iovcnt = 2;
+    }
+
+    if (writev(client_socket, iov, iovcnt) < 0) {
+        log_message("ERROR", "Failed to send embedded asset %s", asset->path);
+    }
+    trace_first_byte(client_socket, 200, iovcnt == 2 ? variant->body_len : 0);
+    return 0;
+}
+
+/**
+ * 输出日志：整行先格式化到本地缓冲区，再用一次 write 输出，多个线程的日志行不会交错
+ * （不超过 PIPE_BUF 的写入对管道也是原子的，超长的行被截断）
+ * @param level 日志级别（DEBUG/INFO/WARN/ERROR）
+ * @param format printf 风格格式串
+ */
+void log_message(const char* level, const char* format, ...) {
+    static const char* levels[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+    int level_index = LOG_LEVEL_ERROR;
+    char line[PIPE_BUF];
+    size_t len;
+    int n;
+    struct tm tm_now;
+    time_t now = time(NULL);
+    va_list args;
+
+    for (int i = 0; i < LOG_LEVEL_NONE; ++i) {
+        if (strcmp(level, levels[i]) == 0) {
+            level_index = i;
+            break;
+        }
+    }
+    if (level_index < log_min_level) {
+        return;
+    }
+
+    len = strftime(line, sizeof(line), "[%Y-%m-%d %H:%M:%S] ", localtime_r(&now, &tm_now));
+    n = snprintf(line + len, sizeof(line) - len, "[%s] ", level);
+    len += n > 0 ? (size_t)n : 0;
+    va_start(args, format);
+    n = vsnprintf(line + len, sizeof(line) - len, format, args);
+    va_end(args);
+    if (n > 0) {
+        len = len + (size_t)n < sizeof(line) - 1 ? len + (size_t)n : sizeof(line) - 2;
+    }
+    line[len++] = '\n';
+    if (write(STDERR_FILENO, line, len) < 0) {
+        // 标准错误不可写时没有别处可报告
+    }
+}
+
+/**
+ * 获取单调时钟纳秒数
+ */
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * 计算客户端 IP 所在的分片与起始槽位
+ */
+static rate_limit_shard_t* rate_limit_locate(uint32_t ip, uint32_t* start_slot) {
+    // 地址是网络字节序，单纯的乘法散列低位只取决于第一个八位组，同一 /16 会挤进同一个探测窗口；
+    // 用 murmur3 的 fmix32 充分混合，使每一位都受全部输入位影响：第 16 位起选分片，低位选槽位
+    uint32_t hash = ip;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    *start_slot = hash & (RATE_LIMIT_SLOTS - 1);
+    return &rate_limit_shards[(hash >> 16) & (RATE_LIMIT_SHARDS - 1)];
+}
+
+/**
+ * 在分片中查找或插入客户端条目（调用方需持有分片锁）
+ * 只在固定的探测窗口内查找，窗口已满时淘汰最久未访问且无活动连接的条目
+ * @return 条目指针；窗口内全部条目都有活动连接时返回 NULL
+ */
+static rate_limit_entry_t* rate_limit_lookup(rate_limit_shard_t* shard, uint32_t start_slot,
+                                             uint32_t ip, int64_t now) {
+    rate_limit_entry_t* empty = NULL;
+    rate_limit_entry_t* victim = NULL;
+
+    for (int i = 0; i < RATE_LIMIT_PROBE_WINDOW; ++i) {
+        rate_limit_entry_t* entry = &shard->slots[(start_slot + i) & (RATE_LIMIT_SLOTS - 1)];
+
+        if (entry->ip == ip && entry->last_seen_ns != 0) {
+            entry->last_seen_ns = now;
+            return entry;
+        }
+        if (entry->last_seen_ns == 0) {
+            if (!empty) empty = entry;
+        } else if (entry->active_connections == 0 &&
+                   (!victim || entry->last_seen_ns < victim->last_seen_ns)) {
+            victim = entry;
+        }
+    }
+
+    if (!empty) {
+        empty = victim;
+    }
+    if (empty) {
+        empty->ip = ip;
+        empty->active_connections = 0;
+        empty->tokens = RATE_LIMIT_BURST;
+        empty->last_refill_ns = now;
+        empty->last_seen_ns = now;
+    }
+    return empty;
+}
+
+/**
+ * 在 accept 时登记连接，超出单 IP 并发连接上限则拒绝
+ * @param ip 客户端 IPv4 地址（网络字节序）
+ * @return 允许返回0，拒绝返回-1
+ */
+int rate_limit_acquire_connection(uint32_t ip) {
+    uint32_t slot;
+    rate_limit_shard_t* shard = rate_limit_locate(ip, &slot);
+    rate_limit_entry_t* entry;
+    int result = 0;
+
+    pthread_mutex_lock(&shard->lock);
+    entry = rate_limit_lookup(shard, slot, ip, monotonic_ns());
+    if (entry) {
+        if (entry->active_connections >= RATE_LIMIT_MAX_CONNECTIONS) {
+            result = -1;
+        } else {
+            entry->active_connections++;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    // 表已被活动连接占满时放行，避免误伤
+    return result;
+}
+
+/**
+ * 连接关闭时释放登记
+ * @param ip 客户端 IPv4 地址（网络字节序）
+ */
+void rate_limit_release_connection(uint32_t ip) {
+    uint32_t slot;
+    rate_limit_shard_t* shard = rate_limit_locate(ip, &slot);
+
+    pthread_mutex_lock(&shard->lock);
+    for (int i = 0; i < RATE_LIMIT_PROBE_WINDOW; ++i) {
+        rate_limit_entry_t* entry = &shard->slots[(slot + i) & (RATE_LIMIT_SLOTS - 1)];
+        if (entry->ip == ip && entry->last_seen_ns != 0) {
+            if (entry->active_connections > 0) {
+                entry->active_connections--;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * 为一次请求消耗一个令牌，令牌在访问时按经过的时间惰性补充
+ * @param ip 客户端 IPv4 地址（网络字节序）
+ * @param retry_after 拒绝时写入建议的重试秒数
+ * @return 允许返回0，拒绝返回-1
+ */
+int rate_limit_take_token(uint32_t ip, int* retry_after) {
+    uint32_t slot;
+    rate_limit_shard_t* shard = rate_limit_locate(ip, &slot);
+    rate_limit_entry_t* entry;
+    int64_t now = monotonic_ns();
+    int result = 0;
+
+    pthread_mutex_lock(&shard->lock);
+    entry = rate_limit_lookup(shard, slot, ip, now);
+    if (entry) {
+        entry->tokens += (double)(now - entry->last_refill_ns) * RATE_LIMIT_RATE / 1e9;
+        if (entry->tokens > RATE_LIMIT_BURST) {
+            entry->tokens = RATE_LIMIT_BURST;
+        }
+        entry->last_refill_ns = now;
+
+        if (entry->tokens >= 1.0) {
+            entry->tokens -= 1.0;
+        } else {
+            *retry_after = (int)((1.0 - entry->tokens) / RATE_LIMIT_RATE) + 1;
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return result;
+}
+
+/**
+ * 发送 429 响应：固定模板一次 send，不经过文件系统
+ * @param client_socket 客户端套接字
+ * @param retry_after 建议的重试秒数
+ */
+void send_too_many_requests(int client_socket, int retry_after) {
+    char response[160];
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 429 Too Many Requests\r\n"
+                       "Retry-After: %d\r\n"
+                       "Content-Length: 0\r\n"
+                       "Connection: close\r\n"
+                       "Server: LitheServer/1.0\r\n"
+                       "\r\n",
+                       retry_after);
+
+    send(client_socket, response, len, MSG_NOSIGNAL);
+    trace_first_byte(client_socket, 429, 0);
+}
+
+/**
+ * 将已接受的连接放入待处理队列，记录入队时间
+ * @param queue 目标工作线程的队列
+ * @param conn 已接受的连接（含 accept 时间戳）
+ * @return 成功返回0，队列已满返回-1
+ */
+int connection_queue_push(connection_queue_t* queue, const pending_connection_t* conn) {
+    int result = -1;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count < CONNECTION_QUEUE_SIZE) {
+        pending_connection_t* item = &queue->items[(queue->head + queue->count) % CONNECTION_QUEUE_SIZE];
+        *item = *conn;
+        item->enqueue_ns = monotonic_ns();
+        queue->count++;
+        pthread_cond_signal(&queue->not_empty);
+        result = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return result;
+}
+
+/**
+ * CoDel 式准入判断（调用方需持有队列锁）
+ * 以 CODEL_INTERVAL_NS 为窗口统计最小排队时间；若整个窗口的最小值仍高于目标值，
+ * 说明存在持续积压，此后排队超过目标值的连接都被拒绝，直到积压消失
+ * @param sojourn_ns 本次出队连接的排队时间
+ * @param now 当前单调时间
+ * @return 准入返回1，应拒绝返回0
+ */
+static int codel_admit(connection_queue_t* queue, int64_t sojourn_ns, int64_t now) {
+    if (sojourn_ns < queue->interval_min_sojourn_ns) {
+        queue->interval_min_sojourn_ns = sojourn_ns;
+    }
+
+    if (now - queue->interval_start_ns >= CODEL_INTERVAL_NS) {
+        int was_overloaded = queue->overloaded;
+        queue->overloaded = queue->interval_min_sojourn_ns > CODEL_TARGET_NS;
+        if (queue->overloaded != was_overloaded) {
+            log_message("WARN", "Load shedding %s (min sojourn %.1fms)",
+                        queue->overloaded ? "started" : "stopped",
+                        queue->interval_min_sojourn_ns / 1e6);
+        }
+        queue->interval_start_ns = now;
+        queue->interval_min_sojourn_ns = sojourn_ns;
+    }
+
+    return !(queue->overloaded && sojourn_ns > CODEL_TARGET_NS);
+}
+
+/**
+ * 取出一个待处理连接，必要时阻塞等待
+ * @param queue 工作线程所属的队列
+ * @param conn 输出出队的连接
+ * @param admitted 输出是否准入
+ * @return 成功返回0，服务器停止时返回-1
+ */
+int connection_queue_pop(connection_queue_t* queue, pending_connection_t* conn, int* admitted) {
+    int64_t now;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == 0) {
+        // 队列清空即积压消失，记为一次零排队时间的样本
+        queue->interval_min_sojourn_ns = 0;
+    }
+    while (queue->count == 0 && server_running) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->count == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+
+    *conn = queue->items[queue->head];
+    queue->head = (queue->head + 1) % CONNECTION_QUEUE_SIZE;
+    queue->count--;
+
+    now = monotonic_ns();
+    *admitted = codel_admit(queue, now - conn->enqueue_ns, now);
+    if (!*admitted) {
+        queue->shed_count++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return 0;
+}
+
+/**
+ * 发送 503 响应：过载时快速拒绝，固定模板一次 send
+ * @param client_socket 客户端套接字
+ */
+void send_service_unavailable(int client_socket) {
+    static const char response[] =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: 1\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "Server: LitheServer/1.0\r\n"
+        "\r\n";
+
+    send(client_socket, response, sizeof(response) - 1, MSG_NOSIGNAL);
+}
+
+/**
+ * 工作线程：从队列取连接并处理
+ * 绑核模式下先设置亲和性再分配连接缓冲区，使其按首次写入策略落在本地 NUMA 节点
+ */
+static void* worker_main(void* arg) {
+    worker_context_t* worker = arg;
+    pending_connection_t conn;
+    int admitted;
+
+    current_worker = worker;
+    if (worker->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            log_message("WARN", "Failed to pin worker %d to CPU %d", worker->index, worker->cpu);
+        }
+    }
+    worker->h2_slab = malloc(sizeof(h2_connection_t));
+    if (worker->h2_slab) {
+        memset(worker->h2_slab, 0, sizeof(h2_connection_t));
+    }
+
+    while (connection_queue_pop(worker->queue, &conn, &admitted) == 0) {
+        int64_t start_ns = monotonic_ns();
+        if (admitted) {
+            conn.timing.dequeue_ns = start_ns;
+            current_timing = &conn.timing;
+            handle_client_connection(conn.socket_fd, &conn.addr, &conn.peer);
+            current_timing = NULL;
+        } else {
+            send_service_unavailable(conn.socket_fd);
+            close(conn.socket_fd);
+        }
+        if (!conn.peer.valid) {
+            rate_limit_release_connection(conn.addr.sin_addr.s_addr);
+        }
+        atomic_fetch_sub(&connections_in_flight, 1);
+        atomic_fetch_add_explicit(&worker->connections, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&worker->busy_ns, (uint_fast64_t)(monotonic_ns() - start_ns),
+                                  memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+/**
+ * 查询 CPU 所在的 NUMA 节点（sysfs 中 cpuN 目录下的 nodeM 链接），未知返回0
+ */
+static int cpu_numa_node(int cpu) {
+    char path[64];
+    DIR* dir;
+    struct dirent* entry;
+    int node = 0;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+/**
+ * 按 NUMA 节点交错排列允许的 CPU：依次取各节点的第 1 个、第 2 个……
+ * 工作线程数受 MAX_WORKERS 限制而少于 CPU 数时，仍均匀分布在所有节点上
+ * @return 涉及的节点数
+ */
+static int interleave_cpus_by_node(int* cpus, int count) {
+    static int node[CPU_SETSIZE];
+    static int rank[CPU_SETSIZE];
+    int node_count = 0;
+
+    for (int i = 0; i < count; ++i) {
+        node[i] = cpu_numa_node(cpus[i]);
+        rank[i] = 0;
+        for (int j = 0; j < i; ++j) {
+            if (node[j] == node[i]) rank[i]++;
+        }
+        if (rank[i] == 0) node_count++;
+    }
+    // 按 (节点内序号, 节点) 插入排序，只在启动时执行一次
+    for (int i = 1; i < count; ++i) {
+        int cpu = cpus[i], n = node[i], r = rank[i];
+        int j = i - 1;
+        while (j >= 0 && (rank[j] > r || (rank[j] == r && node[j] > n))) {
+            cpus[j + 1] = cpus[j];
+            node[j + 1] = node[j];
+            rank[j + 1] = rank[j];
+            j--;
+        }
+        cpus[j + 1] = cpu;
+        node[j + 1] = n;
+        rank[j + 1] = r;
+    }
+    return node_count;
+}
+
+/**
+ * 启动工作线程池
+ * 绑核模式下每个允许的 CPU 一个工作线程（至多 MAX_WORKERS 个），按 NUMA 节点交错分配，
+ * 每个工作线程拥有独立队列；未绑核时 WORKER_COUNT 个工作线程共享一个队列
+ * @return 成功返回0，失败返回-1
+ */
+int start_workers(void) {
+    static int allowed[CPU_SETSIZE];
+    int allowed_count = 0;
+    int node_count = 1;
+    cpu_set_t set;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        cpu_to_worker[cpu] = -1;
+    }
+    if (pin_workers && sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                allowed[allowed_count++] = cpu;
+            }
+        }
+    }
+    if (allowed_count > 0) {
+        node_count = interleave_cpus_by_node(allowed, allowed_count);
+        worker_count = allowed_count < MAX_WORKERS ? allowed_count : MAX_WORKERS;
+        connection_queue_count = worker_count;
+    } else {
+        worker_count = WORKER_COUNT;
+        connection_queue_count = 1;
+    }
+
+    for (int i = 0; i < worker_count; ++i) {
+        worker_context_t* worker = &workers[i];
+        worker->index = i;
+        worker->cpu = allowed_count > 0 ? allowed[i] : -1;
+        worker->queue = &connection_queues[i % connection_queue_count];
+        if (worker->cpu >= 0) {
+            cpu_to_worker[worker->cpu] = i;
+        }
+    }
+
+    workers_started_ns = monotonic_ns();
+    for (int i = 0; i < worker_count; ++i) {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            perror("pthread_create failed");
+            return -1;
+        }
+        pthread_detach(workers[i].thread);
+    }
+    if (allowed_count > 0) {
+        log_message("INFO", "Pinned %d workers across %d CPUs on %d NUMA node(s)",
+                    worker_count, allowed_count, node_count);
+    }
+    return 0;
+}
+
+/**
+ * 将已接受的连接交给工作线程
+ * 绑核模式下优先交给绑定在收包 CPU（SO_INCOMING_CPU）上的工作线程，
+ * 保证协议栈与请求处理共享同一 CPU 的缓存；目标队列已满时依次尝试其他队列
+ * @return 成功返回0，所有队列已满返回-1
+ */
+int dispatch_connection(const pending_connection_t* conn) {
+    int target = -1;
+
+    if (connection_queue_count == 1) {
+        return connection_queue_push(&connection_queues[0], conn);
+    }
+
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (getsockopt(conn->socket_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 &&
+        cpu >= 0 && cpu < CPU_SETSIZE && cpu_to_worker[cpu] >= 0) {
+        target = cpu_to_worker[cpu];
+    } else {
+        target = (int)(dispatch_cursor++ % (unsigned int)worker_count);
+    }
+
+    for (int i = 0; i < worker_count; ++i) {
+        worker_context_t* worker = &workers[(target + i) % worker_count];
+        if (connection_queue_push(worker->queue, conn) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * 输出各工作线程的负载：连接数、忙碌时间占比、队列积压与拒绝数，
+ * 以及忙碌时间的最大值/平均值，便于发现负载不均
+ */
+void report_worker_load(void) {
+    int64_t elapsed_ns = monotonic_ns() - workers_started_ns;
+    uint64_t total_busy = 0;
+    uint64_t max_busy = 0;
+
+    if (workers_started_ns == 0 || elapsed_ns <= 0) {
+        return;
+    }
+    for (int i = 0; i < worker_count; ++i) {
+        worker_context_t* worker = &workers[i];
+        uint64_t connections = atomic_load_explicit(&worker->connections, memory_order_relaxed);
+        uint64_t busy = atomic_load_explicit(&worker->busy_ns, memory_order_relaxed);
+        size_t depth;
+        uint64_t shed;
+
+        pthread_mutex_lock(&worker->queue->lock);
+        depth = worker->queue->count;
+        shed = worker->queue->shed_count;
+        pthread_mutex_unlock(&worker->queue->lock);
+
+        total_busy += busy;
+        if (busy > max_busy) {
+            max_busy = busy;
+        }
+        log_message("INFO", "Worker %d (cpu %d): %llu connections, busy %.1fms (%.1f%%), queued %zu, shed %llu",
+                    i, worker->cpu, (unsigned long long)connections, busy / 1e6,
+                    100.0 * (double)busy / (double)elapsed_ns, depth, (unsigned long long)shed);
+    }
+    if (total_busy > 0) {
+        log_message("INFO", "Worker load imbalance (max/mean busy): %.2f",
+                    (double)max_busy * worker_count / (double)total_busy);
+    }
+    if (api_cache_ttl_ns > 0) {
+        log_message("INFO", "API cache: %llu hits, %llu misses, %llu coalesced",
+                    (unsigned long long)atomic_load(&api_cache.hits),
+                    (unsigned long long)atomic_load(&api_cache.misses),
+                    (unsigned long long)atomic_load(&api_cache.coalesced));
+    }
+}
+
+// ---------- 二进制访问日志 ----------
+//
+// 文件由若干段组成，每次写出的缓冲区自成一段（升级期间新旧进程交替追加同一文件也能解码）：
+//   段头：8 字节魔数 "LITHEAL1" + varint 基准时间（Unix 微秒）
+//   字符串记录：0x01, varint id, varint 长度, 字节
+//       （路径与 User-Agent 在段内首次出现时驻留，之后只写 id；id 在段内有效）
+//   请求记录：0x02, zigzag varint 时间差（微秒，相对上一条记录）, 4 字节 IPv4（网络字节序，
+//       Unix 域连接为 0）, varint 方法 id, varint 路径 id, varint UA id, varint 状态码,
+//       varint 响应体字节数, varint 总耗时（微秒）
+//   id 为 0 表示空字符串
+
+static size_t varint_encode(uint8_t* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static int64_t realtime_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * 查找或驻留字符串（调用方需持有日志锁），新字符串的定义记录写在 out 中
+ * 驻留表满时退化为不驻留：每次都写一条定义记录
+ * @return 字符串 id，空字符串为 0
+ */
+static uint32_t access_log_intern_locked(const char* value, uint8_t* out, size_t* out_len) {
+    access_log_t* log = &access_log;
+    size_t len = strnlen(value, ACCESS_LOG_MAX_STRING);
+    uint64_t hash = 1469598103934665603ULL;
+    access_log_intern_t* free_slot = NULL;
+    uint32_t id;
+
+    if (len == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (uint8_t)value[i]) * 1099511628211ULL;
+    }
+    for (int probe = 0; probe < ACCESS_LOG_INTERN_PROBE; ++probe) {
+        access_log_intern_t* slot = &log->interns[(hash + probe) & (ACCESS_LOG_INTERN_SLOTS - 1)];
+        if (!slot->value) {
+            free_slot = slot;
+            break;
+        }
+        if (slot->hash == hash && strncmp(slot->value, value, len) == 0 && slot->value[len] == '\0') {
+            return slot->id;
+        }
+    }
+
+    id = log->next_id++;
+    if (free_slot && (free_slot->value = strndup(value, len)) != NULL) {
+        free_slot->hash = hash;
+        free_slot->id = id;
+    }
+    out[(*out_len)++] = ACCESS_LOG_STRING;
+    *out_len += varint_encode(out + *out_len, id);
+    *out_len += varint_encode(out + *out_len, len);
+    memcpy(out + *out_len, value, len);
+    *out_len += len;
+    return id;
+}
+
+/**
+ * 在（空的）活动缓冲区开头写入段头并清空驻留表，调用方需持有日志锁
+ * 基准时间沿用上一条记录的时间戳，段内时间差与跨段时一致
+ */
+static void access_log_begin_segment_locked(void) {
+    access_log_t* log = &access_log;
+    size_t len = sizeof(ACCESS_LOG_MAGIC) - 1;
+
+    memcpy(log->active, ACCESS_LOG_MAGIC, len);
+    len += varint_encode(log->active + len, (uint64_t)log->last_timestamp_us);
+    log->active_len = len;
+    log->segment_header_len = len;
+    for (int i = 0; i < ACCESS_LOG_INTERN_SLOTS; ++i) {
+        free(log->interns[i].value);
+        log->interns[i].value = NULL;
+    }
+    log->next_id = 1;
+}
+
+/**
+ * 把一整段日志追加到文件：短写时继续写剩余部分；出现硬错误时截掉本段已写出的部分，
+ * 文件仍以完整的段结尾，后面写入的段照常可以解码
+ * @return 成功返回0，失败返回-1（errno 为写入错误）
+ */
+static int access_log_write_segment(int fd, const uint8_t* data, size_t len) {
+    off_t start = lseek(fd, 0, SEEK_END);
+    size_t written = 0;
+
+    while (written < len) {
+        ssize_t n = write(fd, data + written, len - written);
+        if (n > 0) {
+            written += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        int saved_errno = n < 0 ? errno : EIO;
+        struct stat st;
+        // 只在期间没有别人追加时截断，避免误删退出时同步写出的段
+        if (written > 0 && start >= 0 && fstat(fd, &st) == 0 && st.st_size == start + (off_t)written &&
+            ftruncate(fd, start) != 0) {
+            log_message("ERROR", "Access log truncate failed: %s", strerror(errno));
+        }
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+// 写线程：攒够一批或定时把缓冲区整块写出，工作线程记日志时不做系统调用
+static void* access_log_writer_main(void* arg) {
+    access_log_t* log = &access_log;
+
+    (void)arg;
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ACCESS_LOG_FLUSH_INTERVAL_MS / 1000;
+        while (log->active_len < ACCESS_LOG_FLUSH_THRESHOLD &&
+               pthread_cond_timedwait(&log->flush_needed, &log->lock, &deadline) != ETIMEDOUT) {
+        }
+        if (log->active_len == log->segment_header_len) {
+            continue;
+        }
+
+        uint8_t* full = log->active;
+        size_t len = log->active_len;
+        log->active = log->spare;
+        log->spare = full;
+        access_log_begin_segment_locked();
+        pthread_mutex_unlock(&log->lock);
+
+        if (access_log_write_segment(log->fd, full, len) != 0) {
+            log_message("ERROR", "Access log write failed, %zu bytes lost: %s", len, strerror(errno));
+        }
+        pthread_mutex_lock(&log->lock);
+    }
+    return NULL;
+}
+
+/**
+ * 打开二进制访问日志（追加）并启动写线程
+ * @return 成功返回0，失败返回-1
+ */
+int access_log_open(const char* path) {
+    access_log_t* log = &access_log;
+
+    log->active = malloc(ACCESS_LOG_BUFFER_SIZE);
+    log->spare = malloc(ACCESS_LOG_BUFFER_SIZE);
+    log->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (!log->active || !log->spare || log->fd < 0) {
+        perror("access log open failed");
+        return -1;
+    }
+
+    log->last_timestamp_us = realtime_us();
+    access_log_begin_segment_locked();
+
+    if (pthread_create(&log->writer, NULL, access_log_writer_main, NULL) != 0) {
+        perror("pthread_create failed");
+        return -1;
+    }
+    pthread_detach(log->writer);
+    log_message("INFO", "Writing binary access log to %s", path);
+    return 0;
+}
+
+static uint32_t access_log_method_id(const char* method) {
+    static const char* const methods[] = { "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "PATCH" };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); ++i) {
+        if (strcmp(method, methods[i]) == 0) {
+            return (uint32_t)i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 追加一条请求记录：持锁期间只做驻留表查找和一次 memcpy
+ */
+void access_log_record(const request_timing_t* timing, uint32_t client_ip) {
+    access_log_t* log = &access_log;
+    uint8_t record[ACCESS_LOG_MAX_RECORD];
+    size_t len = 0;
+    uint64_t latency_us = (uint64_t)(timing->complete_ns - timing->accept_ns) / 1000;
+    int64_t now_us;
+    int64_t delta;
+
+    if (log->fd < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&log->lock);
+    if (log->active_len + ACCESS_LOG_MAX_RECORD > ACCESS_LOG_BUFFER_SIZE) {
+        log->dropped++;
+        pthread_mutex_unlock(&log->lock);
+        return;
+    }
+
+    // 驻留串的定义记录必须先于引用它的请求记录
+    uint32_t path_id = access_log_intern_locked(timing->path, record, &len);
+    uint32_t agent_id = access_log_intern_locked(timing->user_agent, record, &len);
+
+    now_us = realtime_us();
+    delta = now_us - log->last_timestamp_us;
+    log->last_timestamp_us = now_us;
+
+    record[len++] = ACCESS_LOG_REQUEST;
+    len += varint_encode(record + len, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    memcpy(record + len, &client_ip, 4);
+    len += 4;
+    len += varint_encode(record + len, access_log_method_id(timing->method));
+    len += varint_encode(record + len, path_id);
+    len += varint_encode(record + len, agent_id);
+    len += varint_encode(record + len, (uint64_t)timing->status);
+    len += varint_encode(record + len, timing->bytes);
+    len += varint_encode(record + len, latency_us);
+
+    memcpy(log->active + log->active_len, record, len);
+    log->active_len += len;
+    if (log->active_len >= ACCESS_LOG_FLUSH_THRESHOLD) {
+        pthread_cond_signal(&log->flush_needed);
+    }
+    pthread_mutex_unlock(&log->lock);
+}
+
+/**
+ * 退出前同步写出缓冲区中剩余的记录
+ */
+void access_log_flush(void) {
+    access_log_t* log = &access_log;
+
+    if (log->fd < 0) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    if (log->active_len > log->segment_header_len &&
+        access_log_write_segment(log->fd, log->active, log->active_len) == 0) {
+        access_log_begin_segment_locked();
+    }
+    if (log->dropped > 0) {
+        log_message("WARN", "Access log dropped %llu records", (unsigned long long)log->dropped);
+    }
+    pthread_mutex_unlock(&log->lock);
+}
+
+// ---------- I/O 缓冲区池 ----------
+
+/**
+ * 映射缓冲区池：优先使用 MAP_HUGETLB 预留的 2MB 大页；
+ * 系统未预留大页时退回普通映射，按 2MB 对齐后通过 MADV_HUGEPAGE 请求透明大页
+ */
+static void io_buffer_pool_init(void) {
+    io_buffer_pool_t* pool = &io_buffer_pool;
+    char* base;
+
+    pool->size = IO_BUFFER_POOL_BYTES;
+    base = mmap(NULL, pool->size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (base != MAP_FAILED) {
+        pool->huge_pages = 1;
+    } else {
+        // 多映射一个大页用于对齐，再裁掉首尾
+        size_t span = pool->size + IO_HUGE_PAGE_SIZE;
+        char* raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            log_message("ERROR", "Failed to map I/O buffer pool: %s", strerror(errno));
+            return;
+        }
+        base = (char*)(((uintptr_t)raw + IO_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(IO_HUGE_PAGE_SIZE - 1));
+        if (base > raw) {
+            munmap(raw, (size_t)(base - raw));
+        }
+        munmap(base + pool->size, (size_t)(raw + span - (base + pool->size)));
+        madvise(base, pool->size, MADV_HUGEPAGE);
+    }
+
+    pool->base = base;
+    for (int i = 0; i < IO_BUFFER_COUNT; ++i) {
+        pool->free_list[i] = (uint16_t)(IO_BUFFER_COUNT - 1 - i);
+    }
+    pool->free_count = IO_BUFFER_COUNT;
+    log_message("INFO", "I/O buffer pool: %d x %d bytes (%s)", IO_BUFFER_COUNT, IO_BUFFER_SIZE,
+                pool->huge_pages ? "hugetlb" : "transparent huge pages");
+}
+
+/**
+ * 借出一个 IO_BUFFER_SIZE 大小的缓冲区
+ * 先查线程本地空闲链表，为空时从全局链表批量取回；池耗尽时退回 malloc
+ * @return 缓冲区，内存不足时返回 NULL
+ */
+char* io_buffer_get(void) {
+    io_buffer_pool_t* pool = &io_buffer_pool;
+    io_buffer_cache_t* cache = &io_buffer_cache;
+
+    pthread_once(&io_buffer_pool_once, io_buffer_pool_init);
+    if (cache->count == 0 && pool->base) {
+        pthread_mutex_lock(&pool->lock);
+        while (cache->count < IO_BUFFER_BATCH && pool->free_count > 0) {
+            cache->items[cache->count++] = pool->free_list[--pool->free_count];
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (cache->count == 0) {
+        return malloc(IO_BUFFER_SIZE);
+    }
+    return pool->base + (size_t)cache->items[--cache->count] * IO_BUFFER_SIZE;
+}
+
+/**
+ * 归还缓冲区；线程本地链表满时把一批还给全局链表，供其他线程使用
+ */
+void io_buffer_put(char* buffer) {
+    io_buffer_pool_t* pool = &io_buffer_pool;
+    io_buffer_cache_t* cache = &io_buffer_cache;
+
+    if (!buffer) {
+        return;
+    }
+    if (!pool->base || buffer < pool->base || buffer >= pool->base + pool->size) {
+        free(buffer);
+        return;
+    }
+    if (cache->count == IO_BUFFER_LOCAL_CACHE) {
+        pthread_mutex_lock(&pool->lock);
+        while (cache->count > IO_BUFFER_LOCAL_CACHE - IO_BUFFER_BATCH) {
+            pool->free_list[pool->free_count++] = cache->items[--cache->count];
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    cache->items[cache->count++] = (uint16_t)((size_t)(buffer - pool->base) / IO_BUFFER_SIZE);
+}
+
+/**
+ * 以每个缓冲区一个 iovec 的形式导出整个池，可直接传给 io_uring_register_buffers；
+ * 第 i 个 iovec 对应的缓冲区即固定缓冲区索引 i（(buffer - base) / IO_BUFFER_SIZE）
+ * @return 写入的 iovec 数，池不可用时返回 0
+ */
+int io_buffer_pool_iovecs(struct iovec* iov, int max) {
+    io_buffer_pool_t* pool = &io_buffer_pool;
+    int count = 0;
+
+    pthread_once(&io_buffer_pool_once, io_buffer_pool_init);
+    if (!pool->base) {
+        return 0;
+    }
+    for (; count < IO_BUFFER_COUNT && count < max; ++count) {
+        iov[count].iov_base = pool->base + (size_t)count * IO_BUFFER_SIZE;
+        iov[count].iov_len = IO_BUFFER_SIZE;
+    }
+    return count;
+}
+
+// ---------- /api/ 上游代理 ----------
+
+/**
+ * 配置上游地址
+ * @param spec "unix:/path/to.sock"、"unix:@抽象名" 或 "host:port"（host 为 IPv4 地址或 localhost）
+ * @return 成功返回0，格式错误返回-1
+ */
+int upstream_configure(const char* spec) {
+    upstream_pool_t* pool = &upstream_pool;
+
+    memset(&pool->addr, 0, sizeof(pool->addr));
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un* addr = (struct sockaddr_un*)&pool->addr;
+        const char* path = spec + 5;
+        size_t path_len = strlen(path);
+
+        if (path_len == 0 || path_len >= sizeof(addr->sun_path)) {
+            return -1;
+        }
+        addr->sun_family = AF_UNIX;
+        memcpy(addr->sun_path, path, path_len);
+        pool->addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path_len);
+        if (path[0] == '@') {
+            addr->sun_path[0] = '\0';
+        } else {
+            pool->addr_len += 1;
+        }
+    } else {
+        struct sockaddr_in* addr = (struct sockaddr_in*)&pool->addr;
+        const char* colon = strrchr(spec, ':');
+        char host[64];
+        int port;
+
+        if (!colon || (size_t)(colon - spec) >= sizeof(host)) {
+            return -1;
+        }
+        snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+        port = atoi(colon + 1);
+        if (port <= 0 || port > 65535) {
+            return -1;
+        }
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(port);
+        if (strcmp(host, "localhost") == 0 || host[0] == '\0') {
+            addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        } else if (inet_pton(AF_INET, host, &addr->sin_addr) != 1) {
+            return -1;
+        }
+        pool->addr_len = sizeof(*addr);
+    }
+
+    snprintf(pool->label, sizeof(pool->label), "%s", spec);
+    pool->configured = 1;
+    log_message("INFO", "Proxying /api/ to upstream %s", spec);
+    return 0;
+}
+
+static int upstream_connect(void) {
+    upstream_pool_t* pool = &upstream_pool;
+    struct timeval timeout = { UPSTREAM_IO_TIMEOUT_MS / 1000, (UPSTREAM_IO_TIMEOUT_MS % 1000) * 1000 };
+    int fd = socket(pool->addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr*)&pool->addr, pool->addr_len) < 0) {
+        log_message("ERROR", "Failed to connect to upstream %s: %s", pool->label, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * 取得一个上游连接：优先复用空闲连接（丢弃超时或已被对端关闭的），否则新建
+ * @param reused 输出是否为复用连接
+ * @return 连接描述符，失败返回-1
+ */
+static int upstream_acquire(int* reused) {
+    upstream_pool_t* pool = &upstream_pool;
+    int64_t now = monotonic_ns();
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->idle_count > 0) {
+        int fd = pool->idle_fds[--pool->idle_count];
+        int64_t idle_since = pool->idle_since_ns[pool->idle_count];
+        char probe;
+
+        pthread_mutex_unlock(&pool->lock);
+        // 空闲连接上不应有数据，可读即表示对端已关闭（或协议错乱）
+        if (now - idle_since < UPSTREAM_IDLE_TIMEOUT_NS &&
+            recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            *reused = 1;
+            return fd;
+        }
+        close(fd);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    *reused = 0;
+    return upstream_connect();
+}
+
+/**
+ * 归还上游连接：响应完整读完且对端允许保持时放回池中，否则关闭
+ */
+static void upstream_release(int fd, int reusable) {
+    upstream_pool_t* pool = &upstream_pool;
+
+    if (reusable) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->idle_count < UPSTREAM_POOL_SIZE) {
+            pool->idle_fds[pool->idle_count] = fd;
+            pool->idle_since_ns[pool->idle_count] = monotonic_ns();
+            pool->idle_count++;
+            fd = -1;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static int send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * 向读取器补充数据（先把未消费的字节移到缓冲区开头）
+ * @return 读到的字节数，对端关闭返回0，出错返回-1
+ */
+static ssize_t stream_reader_fill(stream_reader_t* reader) {
+    ssize_t n;
+
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->end == reader->capacity) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    do {
+        n = recv(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        reader->end += (size_t)n;
+        reader->received = 1;
+    }
+    return n;
+}
+
+/**
+ * 原样转发 n 个字节：先转发缓冲区中已有的部分，其余直接从源读取
+ */
+static int relay_bytes(stream_reader_t* reader, int dst, uint64_t n) {
+    while (n > 0) {
+        size_t available = reader->end - reader->start;
+        if (available == 0) {
+            reader->start = reader->end = 0;
+            if (stream_reader_fill(reader) <= 0) {
+                return -1;
+            }
+            continue;
+        }
+        size_t chunk = available < n ? available : (size_t)n;
+        if (send_all(dst, reader->buffer + reader->start, chunk) != 0) {
+            return -1;
+        }
+        reader->start += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+/**
+ * 转发一行（含 CRLF），并把去掉行尾的内容复制到 line
+ */
+static int relay_line(stream_reader_t* reader, int dst, char* line, size_t line_size) {
+    char* eol;
+
+    while ((eol = memmem(reader->buffer + reader->start, reader->end - reader->start, "\r\n", 2)) == NULL) {
+        if (stream_reader_fill(reader) <= 0) {
+            return -1;
+        }
+    }
+    size_t len = (size_t)(eol - (reader->buffer + reader->start));
+    snprintf(line, line_size, "%.*s", (int)len, reader->buffer + reader->start);
+    return relay_bytes(reader, dst, len + 2);
+}
+
+/**
+ * 转发 chunked 编码的消息体（保持原编码），读到末尾块和尾部字段为止
+ */
+static int relay_chunked(stream_reader_t* reader, int dst) {
+    char line[128];
+
+    for (;;) {
+        char* end;
+        unsigned long long size;
+
+        if (relay_line(reader, dst, line, sizeof(line)) != 0) {
+            return -1;
+        }
+        // 块大小之后只允许扩展（;）或空白，数据后必须紧跟 CRLF，否则分帧不可信
+        errno = 0;
+        size = strtoull(line, &end, 16);
+        if (end == line || !isxdigit((unsigned char)line[0]) || errno == ERANGE ||
+            (*end != '\0' && *end != ';' && *end != ' ' && *end != '\t')) {
+            return -1;
+        }
+        if (size == 0) {
+            break;
+        }
+        if (relay_bytes(reader, dst, size) != 0 || relay_line(reader, dst, line, sizeof(line)) != 0 ||
+            line[0] != '\0') {
+            return -1;
+        }
+    }
+    // 尾部字段，以空行结束
+    do {
+        if (relay_line(reader, dst, line, sizeof(line)) != 0) {
+            return -1;
+        }
+    } while (line[0] != '\0');
+    return 0;
+}
+
+static int relay_until_eof(stream_reader_t* reader, int dst) {
+    for (;;) {
+        ssize_t n;
+        if (reader->end > reader->start) {
+            if (send_all(dst, reader->buffer + reader->start, reader->end - reader->start) != 0) {
+                return -1;
+            }
+        }
+        reader->start = reader->end = 0;
+        n = stream_reader_fill(reader);
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * 在以 CRLF 分隔的头部块中查找字段（不区分大小写）
+ */
+static int find_head_field(const char* head, size_t head_len, const char* name, char* value, size_t value_size) {
+    size_t name_len = strlen(name);
+    const char* line = memmem(head, head_len, "\r\n", 2);
+    const char* end = head + head_len;
+
+    while (line && line + 2 < end) {
+        const char* start = line + 2;
+        const char* eol = memmem(start, (size_t)(end - start), "\r\n", 2);
+        if (!eol || eol == start) {
+            break;
+        }
+        if ((size_t)(eol - start) > name_len && strncasecmp(start, name, name_len) == 0 && start[name_len] == ':') {
+            const char* v = start + name_len + 1;
+            while (v < eol && (*v == ' ' || *v == '\t')) v++;
+            snprintf(value, value_size, "%.*s", (int)(eol - v), v);
+            return 0;
+        }
+        line = eol;
+    }
+    return -1;
+}
+
+/**
+ * 统计头部块中某字段出现的次数
+ */
+static int count_head_fields(const char* head, size_t head_len, const char* name) {
+    size_t name_len = strlen(name);
+    const char* line = memmem(head, head_len, "\r\n", 2);
+    const char* end = head + head_len;
+    int count = 0;
+
+    while (line && line + 2 < end) {
+        const char* start = line + 2;
+        const char* eol = memmem(start, (size_t)(end - start), "\r\n", 2);
+        if (!eol || eol == start) {
+            break;
+        }
+        if ((size_t)(eol - start) > name_len && strncasecmp(start, name, name_len) == 0 && start[name_len] == ':') {
+            count++;
+        }
+        line = eol;
+    }
+    return count;
+}
+
+/**
+ * 解析消息分帧：Transfer-Encoding 只接受 chunked，Content-Length 必须是唯一的十进制数
+ * @param chunked 输出是否为 chunked
+ * @param length 输出 Content-Length，没有该字段为 0
+ * @param has_length 输出是否带有 Content-Length
+ * @return 合法返回0，分帧有歧义或无法解析返回-1
+ */
+static int parse_message_framing(const char* head, size_t head_len, int* chunked, uint64_t* length, int* has_length) {
+    char value[64];
+    int te_count = count_head_fields(head, head_len, "Transfer-Encoding");
+    int cl_count = count_head_fields(head, head_len, "Content-Length");
+
+    *chunked = 0;
+    *length = 0;
+    *has_length = cl_count > 0;
+    if (te_count > 1 || cl_count > 1) {
+        return -1;
+    }
+    if (te_count == 1) {
+        find_head_field(head, head_len, "Transfer-Encoding", value, sizeof(value));
+        if (strcasecmp(value, "chunked") != 0) {
+            return -1;
+        }
+        *chunked = 1;
+    }
+    if (cl_count == 1) {
+        find_head_field(head, head_len, "Content-Length", value, sizeof(value));
+        if (value[0] == '\0') {
+            return -1;
+        }
+        for (const char* c = value; *c; ++c) {
+            if (*c < '0' || *c > '9' || *length > (UINT64_MAX - 9) / 10) {
+                return -1;
+            }
+            *length = *length * 10 + (uint64_t)(*c - '0');
+        }
+    }
+    return 0;
+}
+
+// 逐跳头部：只对单个连接有效，代理不转发
+static int is_hop_by_hop_header(const char* line, size_t len) {
+    static const char* const names[] = {
+        "Connection", "Keep-Alive", "Proxy-Connection", "TE", "Upgrade", "Expect",
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        size_t name_len = strlen(names[i]);
+        if (len > name_len && line[name_len] == ':' && strncasecmp(line, names[i], name_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 复制头部块中的字段行（去掉逐跳头部），追加到 out
+ * @param drop_content_length 同时去掉 Content-Length（消息按 chunked 分帧时）
+ * @return 写入后的长度，空间不足返回-1
+ */
+static ssize_t copy_end_to_end_headers(const char* head, size_t head_len, char* out, size_t out_len, size_t out_cap,
+                                       int drop_content_length) {
+    const char* line = memmem(head, head_len, "\r\n", 2);
+    const char* end = head + head_len;
+
+    while (line && line + 2 < end) {
+        const char* start = line + 2;
+        const char* eol = memmem(start, (size_t)(end - start), "\r\n", 2);
+        if (!eol || eol == start) {
+            break;
+        }
+        size_t len = (size_t)(eol - start) + 2;
+        int is_content_length = len - 2 > 14 && start[14] == ':' && strncasecmp(start, "Content-Length", 14) == 0;
+        if (!is_hop_by_hop_header(start, len - 2) && !(drop_content_length && is_content_length)) {
+            if (out_len + len >= out_cap) {
+                return -1;
+            }
+            memcpy(out + out_len, start, len);
+            out_len += len;
+        }
+        line = eol;
+    }
+    return (ssize_t)out_len;
+}
+
+/**
+ * 转发上游响应：改写逐跳头部后转发头部，再按其分帧方式流式转发消息体
+ * @param head_only 请求为 HEAD
+ * @param reusable 输出响应结束后上游连接能否复用
+ * @param status 输出上游状态码，仅在响应头已转发给客户端后写入；为0说明客户端尚未收到任何响应
+ * @return 成功返回0；未收到任何响应字节返回1（调用方可重试）；其他错误返回-1
+ */
+static int proxy_relay_response(int client_socket, int upstream_fd, char* buffer, char* scratch,
+                                int head_only, int* reusable, int* status) {
+    stream_reader_t reader = { upstream_fd, buffer, IO_BUFFER_SIZE, 0, 0, 0 };
+    char value[64];
+    char* head_end;
+    size_t head_len;
+    ssize_t out_len;
+    uint64_t content_length;
+    int chunked;
+    int has_length;
+    int keep_alive;
+    int upstream_status;
+    int rc;
+
+    *reusable = 0;
+    *status = 0;
+    for (;;) {
+        // 读取完整的响应头；1xx 中间响应直接丢弃
+        while ((head_end = memmem(reader.buffer + reader.start, reader.end - reader.start, "\r\n\r\n", 4)) == NULL) {
+            ssize_t n = stream_reader_fill(&reader);
+            if (n <= 0) {
+                // 复用连接已被上游关闭时，读到的是 EOF 或 RST
+                return reader.received ? -1 : (n == 0 || errno == ECONNRESET ? 1 : -1);
+            }
+        }
+        head_len = (size_t)(head_end + 4 - (reader.buffer + reader.start));
+        if (sscanf(reader.buffer + reader.start, "HTTP/%*d.%*d %d", &upstream_status) != 1) {
+            return -1;
+        }
+        if (upstream_status >= 200 || upstream_status < 100) {
+            break;
+        }
+        reader.start += head_len;
+    }
+
+    const char* head = reader.buffer + reader.start;
+    const char* status_eol = memmem(head, head_len, "\r\n", 2);
+    int http11 = strncmp(head, "HTTP/1.1", 8) == 0;
+
+    keep_alive = http11;
+    if (find_head_field(head, head_len, "Connection", value, sizeof(value)) == 0) {
+        if (strcasestr(value, "close")) keep_alive = 0;
+        if (strcasestr(value, "keep-alive")) keep_alive = 1;
+    }
+
+    // 分帧无法解析时不转发；同时带 chunked 与 Content-Length 时按 chunked 处理，
+    // 去掉 Content-Length 并且不再复用该上游连接
+    if (parse_message_framing(head, head_len, &chunked, &content_length, &has_length) != 0) {
+        return -1;
+    }
+    if (chunked && has_length) {
+        keep_alive = 0;
+    }
+
+    // 客户端连接每次只处理一个请求，统一改为 Connection: close
+    out_len = (ssize_t)(status_eol - head) + 2;
+    memcpy(scratch, head, (size_t)out_len);
+    out_len = copy_end_to_end_headers(head, head_len, scratch, (size_t)out_len, IO_BUFFER_SIZE, chunked);
+    if (out_len < 0 || (size_t)out_len + 24 > IO_BUFFER_SIZE) {
+        return -1;
+    }
+    out_len += snprintf(scratch + out_len, IO_BUFFER_SIZE - (size_t)out_len, "Connection: close\r\n\r\n");
+    if (send_all(client_socket, scratch, (size_t)out_len) != 0) {
+        return -1;
+    }
+    *status = upstream_status;
+    trace_first_byte(client_socket, upstream_status, chunked ? 0 : content_length);
+    reader.start += head_len;
+
+    if (head_only || upstream_status == 204 || upstream_status == 304) {
+        rc = 0;
+    } else if (chunked) {
+        rc = relay_chunked(&reader, client_socket);
+    } else if (has_length) {
+        rc = relay_bytes(&reader, client_socket, content_length);
+    } else {
+        // 以关闭连接界定消息体，上游连接不可复用
+        keep_alive = 0;
+        rc = relay_until_eof(&reader, client_socket);
+    }
+
+    // 上游多发了数据说明协议状态已不可信
+    *reusable = rc == 0 && keep_alive && reader.start == reader.end;
+    return rc == 0 ? 0 : -1;
+}
+
+/**
+ * 判断方法是否幂等，只有幂等请求在陈旧的复用连接上失败后才能重发
+ * @param method 请求方法
+ * @return 幂等返回1，否则返回0
+ */
+static int is_idempotent_method(const char* method) {
+    static const char* const methods[] = { "GET", "HEAD", "PUT", "DELETE", "OPTIONS" };
+
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); ++i) {
+        if (strcmp(method, methods[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 把 /api/ 请求转发到上游，请求体和响应体都流式转发，不整体缓冲
+ * 上游连接来自连接池并在响应完整结束后归还；复用的连接若在发出请求前已被上游关闭，
+ * 且请求为幂等方法、请求体未从客户端继续读取过，则换新连接重试一次
+ * @param client_socket 客户端套接字
+ * @param request 已解析的请求
+ * @param client_ip 客户端地址，用于 X-Forwarded-For
+ * @param buffer 接收缓冲区（IO_BUFFER_SIZE 大小），前 received 字节为已读到的原始请求
+ * @param received 已读取的字节数
+ */
+void proxy_api_request(int client_socket, const http_request_t* request, const char* client_ip,
+                       char* buffer, size_t received) {
+    char* scratch = io_buffer_get();
+    char* response_buffer = io_buffer_get();
+    stream_reader_t client_reader = { client_socket, buffer, IO_BUFFER_SIZE, 0, received, 0 };
+    char value[64];
+    char* head_end;
+    const char* target;
+    const char* target_end;
+    size_t head_len;
+    ssize_t out_len;
+    int head_only = strcmp(request->method, "HEAD") == 0;
+    int idempotent = is_idempotent_method(request->method);
+    int status = 0;
+    int chunked_body;
+    int has_length;
+    uint64_t content_length;
+
+    if (!scratch || !response_buffer) {
+        send_error_response(client_socket, 503);
+        goto out;
+    }
+
+    // 请求头可能跨多次 recv
+    while ((head_end = memmem(buffer, client_reader.end, "\r\n\r\n", 4)) == NULL) {
+        if (stream_reader_fill(&client_reader) <= 0) {
+            send_error_response(client_socket, 400);
+            goto out;
+        }
+    }
+    head_len = (size_t)(head_end + 4 - buffer);
+    client_reader.received = 0;
+
+    // 上游连接是复用的：分帧有歧义（chunked 与 Content-Length 并存、重复或非数字的
+    // Content-Length、非 chunked 的 Transfer-Encoding）的请求一律拒绝，防止请求走私
+    if (parse_message_framing(buffer, head_len, &chunked_body, &content_length, &has_length) != 0 ||
+        (chunked_body && has_length)) {
+        log_message("WARN", "Rejected proxy request with ambiguous framing for %s", request->path);
+        send_error_response(client_socket, 400);
+        goto out;
+    }
+
+    // 重建请求头：请求行 + 端到端头部 + 代理自己的逐跳头部。
+    // request->path 在解析时被截断到 255 字节，请求目标取原始请求行里的
+    target = memchr(buffer, ' ', head_len);
+    target_end = target ? memchr(target + 1, ' ', head_len - (size_t)(target + 1 - buffer)) : NULL;
+    if (!target_end) {
+        send_error_response(client_socket, 400);
+        goto out;
+    }
+    ++target;
+    out_len = snprintf(scratch, IO_BUFFER_SIZE, "%s %.*s HTTP/1.1\r\n", request->method,
+                       (int)(target_end - target), target);
+    if ((size_t)out_len >= IO_BUFFER_SIZE) {
+        send_error_response(client_socket, 414);
+        goto out;
+    }
+    out_len = copy_end_to_end_headers(buffer, head_len, scratch, (size_t)out_len, IO_BUFFER_SIZE, 0);
+    if (out_len < 0 || (size_t)out_len + 96 > IO_BUFFER_SIZE) {
+        send_error_response(client_socket, 400);
+        goto out;
+    }
+    out_len += snprintf(scratch + out_len, IO_BUFFER_SIZE - (size_t)out_len,
+                        "Connection: keep-alive\r\nX-Forwarded-For: %s\r\n\r\n", client_ip);
+
+    // 我们不转发 Expect，由代理自己答复 100 Continue，避免客户端等待
+    if ((chunked_body || content_length > 0) &&
+        find_head_field(buffer, head_len, "Expect", value, sizeof(value)) == 0 &&
+        strcasecmp(value, "100-continue") == 0) {
+        static const char continue_response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        send_all(client_socket, continue_response, sizeof(continue_response) - 1);
+    }
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int reused = 0;
+        int reusable = 0;
+        int rc = -1;
+        int upstream_fd = upstream_acquire(&reused);
+
+        if (upstream_fd < 0) {
+            send_error_response(client_socket, 502);
+            goto out;
+        }
+
+        // 每次尝试都从原始缓冲区中的请求体开始
+        client_reader.start = head_len;
+        if (send_all(upstream_fd, scratch, (size_t)out_len) == 0) {
+            if (chunked_body) {
+                rc = relay_chunked(&client_reader, upstream_fd);
+            } else {
+                rc = relay_bytes(&client_reader, upstream_fd, content_length);
+            }
+            if (rc == 0) {
+                rc = proxy_relay_response(client_socket, upstream_fd, response_buffer, scratch,
+                                          head_only, &reusable, &status);
+            }
+        }
+        upstream_release(upstream_fd, reusable);
+
+        if (rc == 0) {
+            log_message("INFO", "Proxied %s %s -> %d", request->method, request->path, status);
+            goto out;
+        }
+        // 非幂等请求可能已被上游处理过，不能重发
+        if (rc == 1 && reused && idempotent && !client_reader.received && attempt == 0) {
+            log_message("DEBUG", "Stale upstream connection, retrying");
+            continue;
+        }
+        // status 为0说明响应头还没发给客户端，仍可以答复错误
+        if (status == 0) {
+            int timed_out = errno == EAGAIN || errno == EWOULDBLOCK;
+            send_error_response(client_socket, timed_out ? 504 : 502);
+        }
+        log_message("ERROR", "Proxy to %s failed for %s", upstream_pool.label, request->path);
+        goto out;
+    }
+
+out:
+    io_buffer_put(scratch);
+    io_buffer_put(response_buffer);
+}
+
+// ---------- HTTP/2 (h2c) ----------
+
+// HPACK 静态表（RFC 7541 附录 A）
+static const char* const hpack_static_table[][2] = {
+    { ":authority", "" }, { ":method", "GET" }, { ":method", "POST" }, { ":path", "/" },
+    { ":path", "/index.html" }, { ":scheme", "http" }, { ":scheme", "https" }, { ":status", "200" },
+    { ":status", "204" }, { ":status", "206" }, { ":status", "304" }, { ":status", "400" },
+    { ":status", "404" }, { ":status", "500" }, { "accept-charset", "" }, { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" }, { "accept-ranges", "" }, { "accept", "" }, { "access-control-allow-origin", "" },
+    { "age", "" }, { "allow", "" }, { "authorization", "" }, { "cache-control", "" },
+    { "content-disposition", "" }, { "content-encoding", "" }, { "content-language", "" }, { "content-length", "" },
+    { "content-location", "" }, { "content-range", "" }, { "content-type", "" }, { "cookie", "" },
+    { "date", "" }, { "etag", "" }, { "expect", "" }, { "expires", "" },
+    { "from", "" }, { "host", "" }, { "if-match", "" }, { "if-modified-since", "" },
+    { "if-none-match", "" }, { "if-range", "" }, { "if-unmodified-since", "" }, { "last-modified", "" },
+    { "link", "" }, { "location", "" }, { "max-forwards", "" }, { "proxy-authenticate", "" },
+    { "proxy-authorization", "" }, { "range", "" }, { "referer", "" }, { "refresh", "" },
+    { "retry-after", "" }, { "server", "" }, { "set-cookie", "" }, { "strict-transport-security", "" },
+    { "transfer-encoding", "" }, { "user-agent", "" }, { "vary", "" }, { "via", "" },
+    { "www-authenticate", "" },
+};
+#define HPACK_STATIC_COUNT 61
+
+// HPACK 哈夫曼码长（RFC 7541 附录 B）。该编码是规范哈夫曼码，
+// 码字可由码长唯一推出，因此只需保存码长表
+static const uint8_t hpack_huffman_lengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+static uint16_t hpack_huffman_sorted[257];
+static uint32_t hpack_huffman_first_code[31];
+static uint16_t hpack_huffman_first_index[31];
+static uint16_t hpack_huffman_count[31];
+static pthread_once_t hpack_huffman_once = PTHREAD_ONCE_INIT;
+
+/**
+ * 由码长表构建规范哈夫曼解码表
+ */
+static void hpack_huffman_init(void) {
+    uint32_t code = 0;
+    int n = 0;
+
+    for (int len = 1; len <= 30; ++len) {
+        hpack_huffman_first_code[len] = code;
+        hpack_huffman_first_index[len] = (uint16_t)n;
+        for (int sym = 0; sym < 257; ++sym) {
+            if (hpack_huffman_lengths[sym] == len) {
+                hpack_huffman_sorted[n++] = (uint16_t)sym;
+                hpack_huffman_count[len]++;
+                code++;
+            }
+        }
+        code <<= 1;
+    }
+}
+
+/**
+ * 哈夫曼解码
+ * @return 成功返回解码后长度，失败返回-1
+ */
+static ssize_t hpack_huffman_decode(const uint8_t* in, size_t in_len, char* out, size_t out_cap) {
+    uint32_t code = 0;
+    int len = 0;
+    size_t n = 0;
+
+    pthread_once(&hpack_huffman_once, hpack_huffman_init);
+
+    for (size_t i = 0; i < in_len; ++i) {
+        for (int bit = 7; bit >= 0; --bit) {
+            code = (code << 1) | ((in[i] >> bit) & 1);
+            if (++len > 30) {
+                return -1;
+            }
+            if (code - hpack_huffman_first_code[len] < hpack_huffman_count[len]) {
+                uint16_t sym = hpack_huffman_sorted[hpack_huffman_first_index[len] +
+                                                    code - hpack_huffman_first_code[len]];
+                if (sym == 256 || n >= out_cap) {
+                    return -1;  // 码流中出现 EOS，或输出溢出
+                }
+                out[n++] = (char)sym;
+                code = 0;
+                len = 0;
+            }
+        }
+    }
+
+    // 结尾填充必须是不超过 7 位的全 1（EOS 前缀）
+    if (len > 7 || code != (1u << len) - 1) {
+        return -1;
+    }
+    return (ssize_t)n;
+}
+
+/**
+ * 解码 HPACK 整数
+ * @return 成功返回0，失败返回-1
+ */
+static int hpack_decode_int(const uint8_t** pos, const uint8_t* end, int prefix_bits, uint32_t* value) {
+    uint32_t max_prefix = (1u << prefix_bits) - 1;
+    uint32_t result;
+    int shift = 0;
+
+    if (*pos >= end) {
+        return -1;
+    }
+    result = *(*pos)++ & max_prefix;
+    if (result < max_prefix) {
+        *value = result;
+        return 0;
+    }
+
+    while (*pos < end) {
+        uint8_t b = *(*pos)++;
+        if (shift > 21) {
+            return -1;
+        }
+        result += (uint32_t)(b & 0x7f) << shift;
+        shift += 7;
+        if ((b & 0x80) == 0) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * 解码 HPACK 字符串（可能经过哈夫曼编码）
+ * @return 成功返回字符串长度，失败返回-1
+ */
+static ssize_t hpack_decode_string(const uint8_t** pos, const uint8_t* end, char* out, size_t out_cap) {
+    int huffman;
+    uint32_t len;
+    ssize_t n;
+
+    if (*pos >= end) {
+        return -1;
+    }
+    huffman = (**pos & 0x80) != 0;
+    if (hpack_decode_int(pos, end, 7, &len) != 0 || len > (size_t)(end - *pos)) {
+        return -1;
+    }
+
+    if (huffman) {
+        n = hpack_huffman_decode(*pos, len, out, out_cap);
+    } else if (len <= out_cap) {
+        memcpy(out, *pos, len);
+        n = len;
+    } else {
+        n = -1;
+    }
+    *pos += len;
+    return n;
+}
+
+/**
+ * 编码 HPACK 整数
+ * @return 写入的字节数
+ */
+static size_t hpack_encode_int(uint8_t* out, uint32_t value, int prefix_bits, uint8_t flags) {
+    uint32_t max_prefix = (1u << prefix_bits) - 1;
+    size_t n = 0;
+
+    if (value < max_prefix) {
+        out[n++] = flags | (uint8_t)value;
+        return n;
+    }
+    out[n++] = flags | (uint8_t)max_prefix;
+    value -= max_prefix;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+/**
+ * 编码一个“不索引的字面量”头部，名称引用静态表，值不做哈夫曼编码
+ * @return 写入的字节数
+ */
+static size_t hpack_encode_header(uint8_t* out, int static_name_index, const char* value) {
+    size_t value_len = strlen(value);
+    size_t n = hpack_encode_int(out, static_name_index, 4, 0x00);
+
+    n += hpack_encode_int(out + n, value_len, 7, 0x00);
+    memcpy(out + n, value, value_len);
+    return n + value_len;
+}
+
+/**
+ * 释放动态表中最旧的条目
+ */
+static void hpack_table_evict(hpack_table_t* table) {
+    size_t oldest = (table->head + table->count - 1) % HPACK_MAX_ENTRIES;
+    hpack_entry_t* entry = &table->entries[oldest];
+
+    table->size -= entry->name_len + entry->value_len + 32;
+    free(entry->name);
+    entry->name = NULL;
+    table->count--;
+}
+
+/**
+ * 调整动态表上限，淘汰超出部分
+ */
+static void hpack_table_resize(hpack_table_t* table, size_t max_size) {
+    table->max_size = max_size;
+    while (table->count > 0 && table->size > table->max_size) {
+        hpack_table_evict(table);
+    }
+}
+
+/**
+ * 向动态表插入新条目（最新条目索引为 62）
+ */
+static void hpack_table_add(hpack_table_t* table, const char* name, size_t name_len,
+                            const char* value, size_t value_len) {
+    size_t entry_size = name_len + value_len + 32;
+    hpack_entry_t* entry;
+    char* storage;
+
+    while (table->count > 0 && (table->size + entry_size > table->max_size ||
+                                table->count == HPACK_MAX_ENTRIES)) {
+        hpack_table_evict(table);
+    }
+    // 条目大于整表上限时，结果是清空的表
+    if (entry_size > table->max_size) {
+        return;
+    }
+
+    storage = malloc(name_len + value_len + 2);
+    if (!storage) {
+        return;
+    }
+    memcpy(storage, name, name_len);
+    storage[name_len] = '\0';
+    memcpy(storage + name_len + 1, value, value_len);
+    storage[name_len + 1 + value_len] = '\0';
+
+    table->head = (table->head + HPACK_MAX_ENTRIES - 1) % HPACK_MAX_ENTRIES;
+    entry = &table->entries[table->head];
+    entry->name = storage;
+    entry->name_len = name_len;
+    entry->value = storage + name_len + 1;
+    entry->value_len = value_len;
+    table->size += entry_size;
+    table->count++;
+}
+
+/**
+ * 按索引查找头部（静态表在前，动态表在后）
+ * @return 成功返回0，索引无效返回-1
+ */
+static int hpack_table_get(const hpack_table_t* table, uint32_t index,
+                           const char** name, size_t* name_len, const char** value, size_t* value_len) {
+    if (index >= 1 && index <= HPACK_STATIC_COUNT) {
+        *name = hpack_static_table[index - 1][0];
+        *value = hpack_static_table[index - 1][1];
+        *name_len = strlen(*name);
+        *value_len = strlen(*value);
+        return 0;
+    }
+    if (index > HPACK_STATIC_COUNT && index - HPACK_STATIC_COUNT <= table->count) {
+        const hpack_entry_t* entry =
+            &table->entries[(table->head + index - HPACK_STATIC_COUNT - 1) % HPACK_MAX_ENTRIES];
+        *name = entry->name;
+        *name_len = entry->name_len;
+        *value = entry->value;
+        *value_len = entry->value_len;
+        return 0;
+    }
+    return -1;
+}
+
+static void hpack_table_free(hpack_table_t* table) {
+    while (table->count > 0) {
+        hpack_table_evict(table);
+    }
+}
+
+/**
+ * 将解码出的头部写入请求结构体
+ */
+static void h2_on_header(http_request_t* request, int* urgency,
+                         const char* name, size_t name_len, const char* value, size_t value_len) {
+    size_t used;
+
+    if (name_len == 7 && memcmp(name, ":method", 7) == 0) {
+        snprintf(request->method, sizeof(request->method), "%.*s", (int)value_len, value);
+    } else if (name_len == 5 && memcmp(name, ":path", 5) == 0) {
+        snprintf(request->path, sizeof(request->path), "%.*s", (int)value_len, value);
+    } else if (name_len == 10 && memcmp(name, ":authority", 10) == 0) {
+        used = strlen(request->headers);
+        snprintf(request->headers + used, sizeof(request->headers) - used,
+                 "host: %.*s\n", (int)value_len, value);
+    } else if (name[0] != ':') {
+        // RFC 9218 可扩展优先级：priority: u=0..7
+        if (name_len == 8 && memcmp(name, "priority", 8) == 0) {
+            const char* u = memchr(value, 'u', value_len);
+            if (u && u + 2 < value + value_len && u[1] == '=' && u[2] >= '0' && u[2] <= '7') {
+                *urgency = u[2] - '0';
+            }
+        }
+        used = strlen(request->headers);
+        if (used + name_len + value_len + 3 < sizeof(request->headers)) {
+            snprintf(request->headers + used, sizeof(request->headers) - used,
+                     "%.*s: %.*s\n", (int)name_len, name, (int)value_len, value);
+        }
+    }
+}
+
+/**
+ * 解码完整的头部块
+ * @return 成功返回0，压缩错误返回-1
+ */
+static int h2_decode_header_block(h2_connection_t* conn, http_request_t* request, int* urgency) {
+    const uint8_t* pos = conn->header_block;
+    const uint8_t* end = conn->header_block + conn->header_block_len;
+    hpack_table_t* table = &conn->decoder;
+
+    memset(request, 0, sizeof(*request));
+    strcpy(request->version, "HTTP/2");
+
+    while (pos < end) {
+        uint8_t b = *pos;
+        const char* name;
+        const char* value;
+        size_t name_len;
+        size_t value_len;
+        uint32_t index;
+
+        if (b & 0x80) {
+            // 索引头部字段
+            if (hpack_decode_int(&pos, end, 7, &index) != 0 ||
+                hpack_table_get(table, index, &name, &name_len, &value, &value_len) != 0) {
+                return -1;
+            }
+            h2_on_header(request, urgency, name, name_len, value, value_len);
+            continue;
+        }
+
+        if ((b & 0xe0) == 0x20) {
+            // 动态表大小更新
+            if (hpack_decode_int(&pos, end, 5, &index) != 0 || index > HPACK_TABLE_SIZE) {
+                return -1;
+            }
+            hpack_table_resize(table, index);
+            continue;
+        }
+
+        // 字面量：带增量索引（01）、不索引（0000）、永不索引（0001）
+        int incremental = (b & 0xc0) == 0x40;
+        ssize_t n;
+        if (hpack_decode_int(&pos, end, incremental ? 6 : 4, &index) != 0) {
+            return -1;
+        }
+        if (index == 0) {
+            n = hpack_decode_string(&pos, end, conn->scratch_name, sizeof(conn->scratch_name));
+        } else if (hpack_table_get(table, index, &name, &name_len, &value, &value_len) == 0 &&
+                   name_len <= sizeof(conn->scratch_name)) {
+            // 先拷贝名称，插入新条目时被引用的条目可能被淘汰
+            memcpy(conn->scratch_name, name, name_len);
+            n = (ssize_t)name_len;
+        } else {
+            n = -1;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        name_len = (size_t)n;
+
+        n = hpack_decode_string(&pos, end, conn->scratch_value, sizeof(conn->scratch_value));
+        if (n < 0) {
+            return -1;
+        }
+        value_len = (size_t)n;
+
+        if (incremental) {
+            hpack_table_add(table, conn->scratch_name, name_len, conn->scratch_value, value_len);
+        }
+        h2_on_header(request, urgency, conn->scratch_name, name_len, conn->scratch_value, value_len);
+    }
+
+    return 0;
+}
+
+/**
+ * 发送一帧（头部 + 负载一次 writev）
+ * @return 成功返回0，失败返回-1
+ */
+static int h2_send_frame(h2_connection_t* conn, uint8_t type, uint8_t flags, uint32_t stream_id,
+                         const void* payload, size_t len) {
+    uint8_t header[H2_FRAME_HEADER_SIZE];
+    struct iovec iov[2];
+    size_t total = H2_FRAME_HEADER_SIZE + len;
+    size_t sent = 0;
+
+    header[0] = (uint8_t)(len >> 16);
+    header[1] = (uint8_t)(len >> 8);
+    header[2] = (uint8_t)len;
+    header[3] = type;
+    header[4] = flags;
+    header[5] = (uint8_t)(stream_id >> 24) & 0x7f;
+    header[6] = (uint8_t)(stream_id >> 16);
+    header[7] = (uint8_t)(stream_id >> 8);
+    header[8] = (uint8_t)stream_id;
+
+    while (sent < total) {
+        int iovcnt = 0;
+        ssize_t n;
+
+        if (sent < H2_FRAME_HEADER_SIZE) {
+            iov[iovcnt].iov_base = header + sent;
+            iov[iovcnt++].iov_len = H2_FRAME_HEADER_SIZE - sent;
+            iov[iovcnt].iov_base = (void*)payload;
+            iov[iovcnt++].iov_len = len;
+        } else {
+            iov[iovcnt].iov_base = (uint8_t*)payload + (sent - H2_FRAME_HEADER_SIZE);
+            iov[iovcnt++].iov_len = total - sent;
+        }
+
+        n = writev(conn->fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    return 0;
+}
+
+static void h2_send_goaway(h2_connection_t* conn, uint32_t error_code) {
+    uint8_t payload[8];
+
+    payload[0] = (uint8_t)(conn->last_stream_id >> 24) & 0x7f;
+    payload[1] = (uint8_t)(conn->last_stream_id >> 16);
+    payload[2] = (uint8_t)(conn->last_stream_id >> 8);
+    payload[3] = (uint8_t)conn->last_stream_id;
+    payload[4] = (uint8_t)(error_code >> 24);
+    payload[5] = (uint8_t)(error_code >> 16);
+    payload[6] = (uint8_t)(error_code >> 8);
+    payload[7] = (uint8_t)error_code;
+    h2_send_frame(conn, H2_FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+}
+
+static void h2_send_rst_stream(h2_connection_t* conn, uint32_t stream_id, uint32_t error_code) {
+    uint8_t payload[4] = {
+        (uint8_t)(error_code >> 24), (uint8_t)(error_code >> 16),
+        (uint8_t)(error_code >> 8), (uint8_t)error_code
+    };
+    h2_send_frame(conn, H2_FRAME_RST_STREAM, 0, stream_id, payload, sizeof(payload));
+}
+
+static void h2_send_window_update(h2_connection_t* conn, uint32_t stream_id, uint32_t increment) {
+    uint8_t payload[4] = {
+        (uint8_t)(increment >> 24) & 0x7f, (uint8_t)(increment >> 16),
+        (uint8_t)(increment >> 8), (uint8_t)increment
+    };
+    h2_send_frame(conn, H2_FRAME_WINDOW_UPDATE, 0, stream_id, payload, sizeof(payload));
+}
+
+static h2_stream_t* h2_find_stream(h2_connection_t* conn, uint32_t stream_id) {
+    for (int i = 0; i < H2_MAX_STREAMS; ++i) {
+        if (conn->streams[i].id == stream_id) {
+            return &conn->streams[i];
+        }
+    }
+    return NULL;
+}
+
+static void h2_close_stream(h2_stream_t* stream) {
+    file_cache_release(stream->file);
+    memset(stream, 0, sizeof(*stream));
+}
+
+/**
+ * 响应发送完毕后关闭流；客户端仍在发送请求体时用 RST_STREAM(NO_ERROR) 通知其停止
+ * 每个流按自己的时间戳写一条访问日志（延迟从该流的头部块到达算起）
+ */
+static void h2_finish_stream(h2_connection_t* conn, h2_stream_t* stream) {
+    if (!stream->remote_closed) {
+        h2_send_rst_stream(conn, stream->id, H2_NO_ERROR);
+    }
+    if (stream->timing.accept_ns != 0) {
+        char client[64];
+        char client_ip[INET_ADDRSTRLEN];
+
+        stream->timing.complete_ns = monotonic_ns();
+        if (conn->peer.valid) {
+            snprintf(client, sizeof(client), "unix(pid=%d) h2 stream %u", (int)conn->peer.pid, stream->id);
+        } else {
+            inet_ntop(AF_INET, &conn->client_ip, client_ip, sizeof(client_ip));
+            snprintf(client, sizeof(client), "%s h2 stream %u", client_ip, stream->id);
+        }
+        log_slow_request(&stream->timing, client);
+        access_log_record(&stream->timing, conn->peer.valid ? 0 : conn->client_ip);
+    }
+    h2_close_stream(stream);
+}
+
+/**
+ * 为流发送响应头部，并登记响应体的数据来源
+ * @param response 响应描述，body 与 file 二选一
+ * @param head_only 只发送头部（HEAD 请求）
+ */
+static int h2_start_response(h2_connection_t* conn, h2_stream_t* stream,
+                             const h2_response_t* response, int head_only) {
+    uint8_t block[512];
+    char value[32];
+    size_t n = 0;
+    int end_stream = head_only || response->length == 0;
+
+    switch (response->status_code) {
+        case 200: block[n++] = 0x88; break;  // 静态表索引 8
+        case 304: block[n++] = 0x8b; break;
+        case 400: block[n++] = 0x8c; break;
+        case 404: block[n++] = 0x8d; break;
+        case 500: block[n++] = 0x8e; break;
+        default:
+            snprintf(value, sizeof(value), "%d", response->status_code);
+            n += hpack_encode_header(block + n, 8, value);
+            break;
+    }
+    if (response->content_type) {
+        // 可能传入完整的头部行，只取冒号后的值
+        const char* colon = strchr(response->content_type, ':');
+        n += hpack_encode_header(block + n, 31, colon ? colon + 2 : response->content_type);
+    }
+    if (response->status_code != 304) {
+        snprintf(value, sizeof(value), "%zu", response->length);
+        n += hpack_encode_header(block + n, 28, value);
+    }
+    n += hpack_encode_header(block + n, 54, "LitheServer/1.0");
+    for (int i = 0; i < response->extra_count; ++i) {
+        n += hpack_encode_header(block + n, response->extra[i].static_index, response->extra[i].value);
+    }
+
+    if (h2_send_frame(conn, H2_FRAME_HEADERS, H2_FLAG_END_HEADERS | (end_stream ? H2_FLAG_END_STREAM : 0),
+                      stream->id, block, n) != 0) {
+        file_cache_release(response->file);
+        return -1;
+    }
+    trace_first_byte(conn->fd, response->status_code, response->length);
+    stream->timing.first_byte_ns = monotonic_ns();
+    stream->timing.status = response->status_code;
+    stream->timing.bytes = head_only ? 0 : response->length;
+
+    log_message("INFO", "h2 stream %u: %d (%zu bytes)", stream->id, response->status_code, response->length);
+
+    if (end_stream) {
+        file_cache_release(response->file);
+        h2_finish_stream(conn, stream);
+        return 0;
+    }
+
+    stream->responding = 1;
+    stream->remaining = response->length;
+    if (response->file) {
+        stream->file = response->file;
+        stream->file_offset = 0;
+    } else if (response->body_is_static) {
+        stream->body = response->body;
+    } else {
+        memcpy(stream->body_storage, response->body, response->length);
+        stream->body = stream->body_storage;
+    }
+    stream->body_offset = 0;
+    return 0;
+}
+
+/**
+ * 路由一条 HTTP/2 请求，复用 HTTP/1.1 的 API、内嵌资源与静态文件逻辑
+ */
+static int h2_dispatch_request(h2_connection_t* conn, h2_stream_t* stream, const http_request_t* request,
+                               int charge_rate_limit) {
+    h2_response_t h2_response = { 0 };
+    http_response_t response;
+    const embedded_asset_t* asset;
+    int head_only = strcmp(request->method, "HEAD") == 0;
+    int retry_after = 1;
+    char retry_value[16];
+
+    trace_request_parsed(conn->fd, request);
+    stream->timing.accept_ns = monotonic_ns();
+    stream->timing.dequeue_ns = stream->timing.accept_ns;
+    timing_set_request(&stream->timing, request);
+    if (charge_rate_limit && rate_limit_take_token(conn->client_ip, &retry_after) != 0) {
+        snprintf(retry_value, sizeof(retry_value), "%d", retry_after);
+        h2_response.status_code = 429;
+        h2_response.extra[h2_response.extra_count++] = (h2_header_t){ 53, retry_value };
+        return h2_start_response(conn, stream, &h2_response, 1);
+    }
+
+    trace_handler_start(conn->fd, request->path);
+    stream->timing.handler_ns = monotonic_ns();
+    if (strncmp(request->path, "/api/", 5) == 0 && upstream_pool.configured) {
+        // h2 流不走上游代理；421 让客户端换一条连接（HTTP/1.1）重试，而不是拿到本地结果
+        h2_response.status_code = 421;
+        return h2_start_response(conn, stream, &h2_response, 1);
+    } else if (strncmp(request->path, "/api/", 5) == 0) {
+        build_api_response_cached(request, &response);
+    } else if ((asset = find_embedded_asset(request->path)) != NULL) {
+        int encoding = choose_asset_encoding(asset, request);
+        const embedded_variant_t* variant = &asset->variants[encoding];
+
+        h2_response.extra[h2_response.extra_count++] = (h2_header_t){ 34, asset->etag };
+        h2_response.extra[h2_response.extra_count++] = (h2_header_t){ 24, asset->cache_control };
+        if (asset_not_modified(asset, request)) {
+            h2_response.status_code = 304;
+            return h2_start_response(conn, stream, &h2_response, 1);
+        }
+        h2_response.status_code = 200;
+        h2_response.content_type = asset->content_type;
+        h2_response.body = (const char*)variant->body;
+        h2_response.length = variant->body_len;
+        h2_response.body_is_static = 1;
+        h2_response.extra[h2_response.extra_count++] = (h2_header_t){ 59, "Accept-Encoding" };
+        if (encoding != ASSET_IDENTITY) {
+            h2_response.extra[h2_response.extra_count++] =
+                (h2_header_t){ 26, encoding == ASSET_GZIP ? "gzip" : "br" };
+        }
+        return h2_start_response(conn, stream, &h2_response, head_only);
+    } else {
+        char local_path[512];
+        int status;
+        file_cache_entry_t* file = open_static_file(request->path, local_path, sizeof(local_path), &status);
+
+        if (file) {
+            h2_response.status_code = 200;
+            h2_response.content_type = guess_content_type(local_path);
+            h2_response.length = (size_t)file->st.st_size;
+            h2_response.file = file;
+            return h2_start_response(conn, stream, &h2_response, head_only);
+        }
+        char body[64];
+        snprintf(body, sizeof(body), "<h1>%d</h1>", status);
+        build_http_response(&response, status, CONTENT_TYPE_HTML_LINE, body);
+    }
+
+    h2_response.status_code = response.status_code;
+    h2_response.content_type = response.content_type;
+    h2_response.body = response.body;
+    h2_response.length = response.content_length;
+    return h2_start_response(conn, stream, &h2_response, head_only);
+}
+
+/**
+ * 头部块接收完毕：解码并创建流
+ * @return 成功返回0，连接级错误返回 H2 错误码
+ */
+static uint32_t h2_on_header_block(h2_connection_t* conn) {
+    uint32_t stream_id = conn->header_stream_id;
+    int urgency = H2_DEFAULT_URGENCY;
+    h2_stream_t* stream;
+
+    // 即使要拒绝该流也必须解码，以保持 HPACK 状态同步
+    if (h2_decode_header_block(conn, &conn->request, &urgency) != 0) {
+        return H2_COMPRESSION_ERROR;
+    }
+    conn->header_block_len = 0;
+    conn->header_stream_id = 0;
+
+    if (stream_id <= conn->last_stream_id) {
+        // 已有流上的尾部头部（trailers），忽略
+        stream = h2_find_stream(conn, stream_id);
+        if (stream && (conn->header_flags & H2_FLAG_END_STREAM)) {
+            stream->remote_closed = 1;
+        }
+        return 0;
+    }
+    conn->last_stream_id = stream_id;
+
+    stream = h2_find_stream(conn, 0);
+    if (!stream) {
+        h2_send_rst_stream(conn, stream_id, H2_REFUSED_STREAM);
+        return 0;
+    }
+    if (conn->request.method[0] == '\0' || conn->request.path[0] == '\0') {
+        h2_send_rst_stream(conn, stream_id, H2_PROTOCOL_ERROR);
+        return 0;
+    }
+
+    stream->id = stream_id;
+    stream->send_window = (int32_t)conn->peer_initial_window;
+    stream->urgency = urgency;
+    stream->remote_closed = (conn->header_flags & H2_FLAG_END_STREAM) != 0;
+
+    conn->request.peer = conn->peer;
+    if (h2_dispatch_request(conn, stream, &conn->request, !conn->peer.valid) != 0) {
+        return H2_INTERNAL_ERROR;
+    }
+    return 0;
+}
+
+/**
+ * 应用对端的 SETTINGS 参数
+ * @return 成功返回0，失败返回 H2 错误码
+ */
+static uint32_t h2_apply_settings(h2_connection_t* conn, const uint8_t* payload, size_t len) {
+    if (len % 6 != 0) {
+        return H2_FRAME_SIZE_ERROR;
+    }
+
+    for (size_t i = 0; i < len; i += 6) {
+        uint16_t id = (uint16_t)(payload[i] << 8 | payload[i + 1]);
+        uint32_t value = (uint32_t)payload[i + 2] << 24 | (uint32_t)payload[i + 3] << 16 |
+                         (uint32_t)payload[i + 4] << 8 | payload[i + 5];
+        int64_t delta;
+
+        switch (id) {
+            case H2_SETTINGS_ENABLE_PUSH:
+                if (value > 1) return H2_PROTOCOL_ERROR;
+                break;
+            case H2_SETTINGS_INITIAL_WINDOW_SIZE:
+                if (value > 0x7fffffff) return H2_FLOW_CONTROL_ERROR;
+                // 新的初始窗口按差值作用于所有已打开的流；先检查再修改，任一流超出 2^31-1 即为连接错误
+                delta = (int64_t)value - (int64_t)conn->peer_initial_window;
+                for (int s = 0; s < H2_MAX_STREAMS; ++s) {
+                    if (conn->streams[s].id != 0 && conn->streams[s].send_window + delta > 0x7fffffff) {
+                        return H2_FLOW_CONTROL_ERROR;
+                    }
+                }
+                for (int s = 0; s < H2_MAX_STREAMS; ++s) {
+                    if (conn->streams[s].id != 0) {
+                        conn->streams[s].send_window = (int32_t)(conn->streams[s].send_window + delta);
+                    }
+                }
+                conn->peer_initial_window = value;
+                break;
+            case H2_SETTINGS_MAX_FRAME_SIZE:
+                if (value < 16384 || value > 16777215) return H2_PROTOCOL_ERROR;
+                conn->peer_max_frame_size = value;
+                break;
+            default:
+                // HEADER_TABLE_SIZE 只影响我们的编码器，而编码器不使用动态表
+                break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 处理一帧
+ * @return 成功返回0，连接级错误返回 H2 错误码
+ */
+static uint32_t h2_process_frame(h2_connection_t* conn, uint8_t type, uint8_t flags, uint32_t stream_id,
+                                 const uint8_t* payload, size_t len) {
+    h2_stream_t* stream;
+    uint32_t value;
+
+    // 头部块未结束时只允许同一流的 CONTINUATION
+    if (conn->header_stream_id != 0 &&
+        (type != H2_FRAME_CONTINUATION || stream_id != conn->header_stream_id)) {
+        return H2_PROTOCOL_ERROR;
+    }
+
+    switch (type) {
+        case H2_FRAME_DATA:
+            if (stream_id == 0) return H2_PROTOCOL_ERROR;
+            // 请求体直接丢弃，立即归还流量控制窗口
+            if (len > 0) {
+                h2_send_window_update(conn, 0, (uint32_t)len);
+                stream = h2_find_stream(conn, stream_id);
+                if (stream && !(flags & H2_FLAG_END_STREAM)) {
+                    h2_send_window_update(conn, stream_id, (uint32_t)len);
+                }
+            }
+            stream = h2_find_stream(conn, stream_id);
+            if (stream && (flags & H2_FLAG_END_STREAM)) {
+                stream->remote_closed = 1;
+            }
+            return 0;
+
+        case H2_FRAME_HEADERS: {
+            size_t pad = 0;
+            if (stream_id == 0 || (stream_id & 1) == 0) return H2_PROTOCOL_ERROR;
+            if (flags & H2_FLAG_PADDED) {
+                if (len < 1) return H2_FRAME_SIZE_ERROR;
+                pad = payload[0];
+                payload++;
+                len--;
+            }
+            if (flags & H2_FLAG_PRIORITY) {
+                // RFC 7540 依赖树已被 RFC 9113 废弃，调度改用 priority 头部
+                if (len < 5) return H2_FRAME_SIZE_ERROR;
+                payload += 5;
+                len -= 5;
+            }
+            if (pad > len) return H2_PROTOCOL_ERROR;
+            len -= pad;
+            if (len > sizeof(conn->header_block)) return H2_ENHANCE_YOUR_CALM;
+
+            memcpy(conn->header_block, payload, len);
+            conn->header_block_len = len;
+            conn->header_stream_id = stream_id;
+            conn->header_flags = flags;
+            return (flags & H2_FLAG_END_HEADERS) ? h2_on_header_block(conn) : 0;
+        }
+
+        case H2_FRAME_CONTINUATION:
+            if (conn->header_stream_id == 0) return H2_PROTOCOL_ERROR;
+            if (conn->header_block_len + len > sizeof(conn->header_block)) return H2_ENHANCE_YOUR_CALM;
+            memcpy(conn->header_block + conn->header_block_len, payload, len);
+            conn->header_block_len += len;
+            return (flags & H2_FLAG_END_HEADERS) ? h2_on_header_block(conn) : 0;
+
+        case H2_FRAME_PRIORITY:
+            return len == 5 ? 0 : H2_FRAME_SIZE_ERROR;
+
+        case H2_FRAME_RST_STREAM:
+            if (stream_id == 0) return H2_PROTOCOL_ERROR;
+            if (len != 4) return H2_FRAME_SIZE_ERROR;
+            stream = h2_find_stream(conn, stream_id);
+            if (stream) {
+                h2_close_stream(stream);
+            }
+            return 0;
+
+        case H2_FRAME_SETTINGS:
+            if (stream_id != 0) return H2_PROTOCOL_ERROR;
+            if (flags & H2_FLAG_ACK) {
+                return len == 0 ? 0 : H2_FRAME_SIZE_ERROR;
+            }
+            value = h2_apply_settings(conn, payload, len);
+            if (value != 0) return value;
+            return h2_send_frame(conn, H2_FRAME_SETTINGS, H2_FLAG_ACK, 0, NULL, 0) == 0 ? 0 : H2_INTERNAL_ERROR;
+
+        case H2_FRAME_PUSH_PROMISE:
+            return H2_PROTOCOL_ERROR;  // 客户端不得推送
+
+        case H2_FRAME_PING:
+            if (stream_id != 0) return H2_PROTOCOL_ERROR;
+            if (len != 8) return H2_FRAME_SIZE_ERROR;
+            if (!(flags & H2_FLAG_ACK)) {
+                h2_send_frame(conn, H2_FRAME_PING, H2_FLAG_ACK, 0, payload, 8);
+            }
+            return 0;
+
+        case H2_FRAME_GOAWAY:
+            conn->peer_goaway = 1;
+            return 0;
+
+        case H2_FRAME_WINDOW_UPDATE:
+            if (len != 4) return H2_FRAME_SIZE_ERROR;
+            value = ((uint32_t)payload[0] << 24 | (uint32_t)payload[1] << 16 |
+                     (uint32_t)payload[2] << 8 | payload[3]) & 0x7fffffff;
+            if (stream_id == 0) {
+                if (value == 0) return H2_PROTOCOL_ERROR;
+                if ((int64_t)conn->send_window + value > 0x7fffffff) return H2_FLOW_CONTROL_ERROR;
+                conn->send_window += (int32_t)value;
+            } else if ((stream = h2_find_stream(conn, stream_id)) != NULL) {
+                if (value == 0 || (int64_t)stream->send_window + value > 0x7fffffff) {
+                    h2_send_rst_stream(conn, stream_id, value == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+                    h2_close_stream(stream);
+                } else {
+                    stream->send_window += (int32_t)value;
+                }
+            }
+            return 0;
+
+        default:
+            return 0;  // 未知帧类型必须忽略
+    }
+}
+
+/**
+ * 按优先级发送待发的 DATA 帧
+ * 先发紧急度最高（urgency 最小）的流，同一紧急度内轮转，受连接与流两级窗口约束
+ * @return 成功返回0，写失败返回-1
+ */
+static int h2_send_pending(h2_connection_t* conn) {
+    size_t max_frame = conn->peer_max_frame_size < H2_MAX_FRAME_SIZE ? conn->peer_max_frame_size
+                                                                      : H2_MAX_FRAME_SIZE;
+
+    for (int burst = 0; burst < H2_SEND_BURST && conn->send_window > 0; ++burst) {
+        h2_stream_t* next = NULL;
+
+        for (int i = 1; i <= H2_MAX_STREAMS; ++i) {
+            h2_stream_t* candidate = &conn->streams[(conn->rr_cursor + i) % H2_MAX_STREAMS];
+            if (candidate->id != 0 && candidate->responding && candidate->send_window > 0 &&
+                (!next || candidate->urgency < next->urgency)) {
+                next = candidate;
+            }
+        }
+        if (!next) {
+            break;
+        }
+        conn->rr_cursor = (int)(next - conn->streams);
+
+        size_t chunk = next->remaining;
+        if (chunk > max_frame) chunk = max_frame;
+        if (chunk > (size_t)next->send_window) chunk = (size_t)next->send_window;
+        if (chunk > (size_t)conn->send_window) chunk = (size_t)conn->send_window;
+
+        const uint8_t* data;
+        if (next->file) {
+            ssize_t n = pread(next->file->fd, conn->send_buffer, chunk, next->file_offset);
+            if (n <= 0) {
+                h2_send_rst_stream(conn, next->id, H2_INTERNAL_ERROR);
+                h2_close_stream(next);
+                continue;
+            }
+            chunk = (size_t)n;
+            next->file_offset += n;
+            data = conn->send_buffer;
+        } else {
+            data = (const uint8_t*)next->body + next->body_offset;
+            next->body_offset += chunk;
+        }
+
+        next->remaining -= chunk;
+        next->send_window -= (int32_t)chunk;
+        conn->send_window -= (int32_t)chunk;
+
+        if (h2_send_frame(conn, H2_FRAME_DATA, next->remaining == 0 ? H2_FLAG_END_STREAM : 0,
+                          next->id, data, chunk) != 0) {
+            return -1;
+        }
+        if (next->remaining == 0) {
+            h2_finish_stream(conn, next);
+        }
+    }
+    return 0;
+}
+
+/**
+ * 取得一个清零的连接状态：工作线程复用自己的本地缓冲区，其他线程临时分配
+ */
+static h2_connection_t* h2_connection_acquire(void) {
+    if (current_worker && current_worker->h2_slab) {
+        memset(current_worker->h2_slab, 0, sizeof(h2_connection_t));
+        return current_worker->h2_slab;
+    }
+    return calloc(1, sizeof(h2_connection_t));
+}
+
+static void h2_connection_release(h2_connection_t* conn) {
+    if (!current_worker || conn != current_worker->h2_slab) {
+        free(conn);
+    }
+}
+
+/**
+ * 判断是否还有可立即发送的数据
+ */
+static int h2_has_sendable(const h2_connection_t* conn, int* active_streams) {
+    int sendable = 0;
+
+    *active_streams = 0;
+    for (int i = 0; i < H2_MAX_STREAMS; ++i) {
+        const h2_stream_t* stream = &conn->streams[i];
+        if (stream->id != 0) {
+            (*active_streams)++;
+            if (stream->responding && stream->send_window > 0 && conn->send_window > 0) {
+                sendable = 1;
+            }
+        }
+    }
+    return sendable;
+}
+
+/**
+ * 判断当前工作线程的队列中是否有连接在等待（非工作线程调用时返回0）
+ */
+static int h2_worker_has_waiters(void) {
+    size_t waiting;
+
+    if (!current_worker) {
+        return 0;
+    }
+    pthread_mutex_lock(&current_worker->queue->lock);
+    waiting = current_worker->queue->count;
+    pthread_mutex_unlock(&current_worker->queue->lock);
+    return waiting > 0;
+}
+
+/**
+ * base64url 解码（HTTP2-Settings 头部）
+ * @return 解码后的字节数，失败返回-1
+ */
+static ssize_t base64url_decode(const char* in, uint8_t* out, size_t out_cap) {
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+
+    for (; *in && *in != '='; ++in) {
+        int v;
+        if (*in >= 'A' && *in <= 'Z') v = *in - 'A';
+        else if (*in >= 'a' && *in <= 'z') v = *in - 'a' + 26;
+        else if (*in >= '0' && *in <= '9') v = *in - '0' + 52;
+        else if (*in == '-' || *in == '+') v = 62;
+        else if (*in == '_' || *in == '/') v = 63;
+        else return -1;
+
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (n >= out_cap) return -1;
+            out[n++] = (uint8_t)(acc >> bits);
+        }
+    }
+    return (ssize_t)n;
+}
+
+/**
+ * 在 HTTP/1.1 请求头中查找指定头部（不区分大小写）
+ * @return 找到返回0，否则返回-1
+ */
+int find_request_header(const http_request_t* request, const char* name, char* value, size_t value_size) {
+    size_t name_len = strlen(name);
+    const char* line = request->headers;
+
+    while (*line) {
+        const char* eol = strchr(line, '\n');
+        size_t line_len = eol ? (size_t)(eol - line) : strlen(line);
+
+        if (line_len > name_len && strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char* v = line + name_len + 1;
+            while (*v == ' ' || *v == '\t') v++;
+            snprintf(value, value_size, "%.*s", (int)(line + line_len - v), v);
+            return 0;
+        }
+        if (!eol) break;
+        line = eol + 1;
+    }
+    return -1;
+}
+
+/**
+ * 运行一个 HTTP/2 连接（先验知识或 h2c 升级）
+ * @param client_socket 客户端套接字（函数返回前不会关闭）
+ * @param client_ip 客户端 IPv4 地址（网络字节序）
+ * @param peer 对端凭据（Unix 域连接不参与限流）
+ * @param initial 已读取但未处理的字节
+ * @param initial_len initial 的长度
+ * @param upgraded_request h2c 升级时的原始请求，作为流 1 响应；先验知识模式为 NULL
+ */
+void h2_serve_connection(int client_socket, uint32_t client_ip, const peer_credentials_t* peer,
+                         const char* initial, size_t initial_len, const http_request_t* upgraded_request) {
+    static const uint8_t server_settings[] = {
+        0x00, H2_SETTINGS_MAX_CONCURRENT_STREAMS, 0, 0, 0, H2_MAX_STREAMS,
+        0x00, H2_SETTINGS_MAX_HEADER_LIST_SIZE, 0, 0, (H2_HEADER_BLOCK_SIZE >> 8) & 0xff, H2_HEADER_BLOCK_SIZE & 0xff,
+    };
+    h2_connection_t* conn = h2_connection_acquire();
+    uint32_t error = H2_NO_ERROR;
+    int preface_done = 0;
+    int idle_ms = 0;
+
+    if (!conn) {
+        return;
+    }
+    if (current_timing) {
+        current_timing->multiplexed = 1;
+    }
+    conn->fd = client_socket;
+    conn->client_ip = client_ip;
+    conn->peer = *peer;
+    conn->send_window = H2_DEFAULT_WINDOW;
+    conn->peer_initial_window = H2_DEFAULT_WINDOW;
+    conn->peer_max_frame_size = H2_MAX_FRAME_SIZE;
+    conn->decoder.max_size = HPACK_TABLE_SIZE;
+
+    if (initial_len > sizeof(conn->recv_buffer)) {
+        initial_len = sizeof(conn->recv_buffer);
+    }
+    memcpy(conn->recv_buffer, initial, initial_len);
+    conn->recv_len = initial_len;
+
+    if (upgraded_request) {
+        static const char switching[] =
+            "HTTP/1.1 101 Switching Protocols\r\n"
+            "Connection: Upgrade\r\n"
+            "Upgrade: h2c\r\n"
+            "\r\n";
+        char settings_b64[128];
+        uint8_t settings[96];
+        ssize_t settings_len = -1;
+
+        if (find_request_header(upgraded_request, "HTTP2-Settings", settings_b64, sizeof(settings_b64)) == 0) {
+            settings_len = base64url_decode(settings_b64, settings, sizeof(settings));
+        }
+        if (settings_len < 0 || send(client_socket, switching, sizeof(switching) - 1, MSG_NOSIGNAL) < 0) {
+            h2_connection_release(conn);
+            return;
+        }
+        h2_send_frame(conn, H2_FRAME_SETTINGS, 0, 0, server_settings, sizeof(server_settings));
+        if (h2_apply_settings(conn, settings, (size_t)settings_len) != 0) {
+            h2_send_goaway(conn, H2_PROTOCOL_ERROR);
+            h2_connection_release(conn);
+            return;
+        }
+
+        // 升级请求成为流 1，请求方向已关闭
+        h2_stream_t* stream = &conn->streams[0];
+        stream->id = 1;
+        stream->send_window = (int32_t)conn->peer_initial_window;
+        stream->urgency = H2_DEFAULT_URGENCY;
+        stream->remote_closed = 1;
+        conn->last_stream_id = 1;
+        if (h2_dispatch_request(conn, stream, upgraded_request, 0) != 0) {
+            h2_connection_release(conn);
+            return;
+        }
+    } else {
+        h2_send_frame(conn, H2_FRAME_SETTINGS, 0, 0, server_settings, sizeof(server_settings));
+    }
+
+    while (server_running) {
+        size_t offset = 0;
+        int active_streams;
+        int sendable;
+        struct pollfd pfd;
+        ssize_t n;
+
+        // 连接序言
+        if (!preface_done) {
+            if (conn->recv_len >= H2_PREFACE_LEN) {
+                if (memcmp(conn->recv_buffer, H2_PREFACE, H2_PREFACE_LEN) != 0) {
+                    error = H2_PROTOCOL_ERROR;
+                    break;
+                }
+                offset = H2_PREFACE_LEN;
+                preface_done = 1;
+            }
+        }
+
+        // 处理缓冲区中所有完整的帧
+        while (preface_done && conn->recv_len - offset >= H2_FRAME_HEADER_SIZE) {
+            const uint8_t* frame = conn->recv_buffer + offset;
+            size_t len = (size_t)frame[0] << 16 | (size_t)frame[1] << 8 | frame[2];
+            uint32_t stream_id = ((uint32_t)frame[5] << 24 | (uint32_t)frame[6] << 16 |
+                                  (uint32_t)frame[7] << 8 | frame[8]) & 0x7fffffff;
+
+            if (len > H2_MAX_FRAME_SIZE) {
+                error = H2_FRAME_SIZE_ERROR;
+                break;
+            }
+            if (conn->recv_len - offset < H2_FRAME_HEADER_SIZE + len) {
+                break;
+            }
+            error = h2_process_frame(conn, frame[3], frame[4], stream_id, frame + H2_FRAME_HEADER_SIZE, len);
+            if (error != H2_NO_ERROR) {
+                break;
+            }
+            offset += H2_FRAME_HEADER_SIZE + len;
+        }
+        if (error != H2_NO_ERROR) {
+            break;
+        }
+        memmove(conn->recv_buffer, conn->recv_buffer + offset, conn->recv_len - offset);
+        conn->recv_len -= offset;
+
+        if (h2_send_pending(conn) != 0) {
+            break;
+        }
+
+        sendable = h2_has_sendable(conn, &active_streams);
+        if (conn->peer_goaway && active_streams == 0) {
+            break;
+        }
+
+        // 有可发送数据时只做非阻塞读取；否则分片等待新帧：
+        // 没有活动流且队列中有连接在等时发 GOAWAY 让出工作线程，总空闲超时后关闭连接
+        pfd.fd = client_socket;
+        pfd.events = POLLIN;
+        n = poll(&pfd, 1, sendable ? 0 : H2_IDLE_SLICE_MS);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0) {
+            if (sendable) continue;
+            idle_ms += H2_IDLE_SLICE_MS;
+            if (idle_ms >= H2_IDLE_TIMEOUT_MS || (active_streams == 0 && h2_worker_has_waiters())) {
+                break;
+            }
+            continue;
+        }
+        idle_ms = 0;
+        if (n < 0) {
+            break;
+        }
+
+        n = recv(client_socket, conn->recv_buffer + conn->recv_len, sizeof(conn->recv_buffer) - conn->recv_len, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            conn->peer_goaway = 1;
+            break;
+        }
+        conn->recv_len += (size_t)n;
+    }
+
+    if (!conn->peer_goaway) {
+        h2_send_goaway(conn, error);
+    }
+    for (int i = 0; i < H2_MAX_STREAMS; ++i) {
+        h2_close_stream(&conn->streams[i]);
+    }
+    hpack_table_free(&conn->decoder);
+    h2_connection_release(conn);
+}
+
+/**
+ * 释放文件缓存条目的一个引用，最后一个引用负责关闭文件
+ */
+void file_cache_release(file_cache_entry_t* entry) {
+    if (entry && atomic_fetch_sub(&entry->refcount, 1) == 1) {
+        close(entry->fd);
+        free(entry);
+    }
+}
+
+/**
+ * 路径散列（FNV-1a）
+ */
+static uint32_t file_cache_hash(const char* path) {
+    uint32_t hash = 2166136261u;
+
+    while (*path) {
+        hash = (hash ^ (uint8_t)*path++) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * 移除并释放匹配的缓存条目（调用方需持有缓存锁）
+ * @param path 文件路径；prefix 为真时移除该目录下的所有条目
+ */
+static void file_cache_remove_locked(const char* path, int prefix) {
+    size_t path_len = strlen(path);
+
+    if (!prefix) {
+        uint32_t start = file_cache_hash(path);
+        for (int i = 0; i < FILE_CACHE_PROBE_WINDOW; ++i) {
+            file_cache_entry_t** slot = &file_cache.slots[(start + i) & (FILE_CACHE_SLOTS - 1)];
+            if (*slot && strcmp((*slot)->path, path) == 0) {
+                file_cache_release(*slot);
+                *slot = NULL;
+            }
+        }
+        return;
+    }
+
+    for (int i = 0; i < FILE_CACHE_SLOTS; ++i) {
+        file_cache_entry_t* entry = file_cache.slots[i];
+        if (entry && (path_len == 0 ||
+                      (strncmp(entry->path, path, path_len) == 0 && entry->path[path_len] == '/'))) {
+            file_cache_release(entry);
+            file_cache.slots[i] = NULL;
+        }
+    }
+}
+
+/**
+ * 消费 inotify 线程推送的失效通知（调用方需持有缓存锁，不产生系统调用）
+ * @param path 关注的路径，可为 NULL
+ * @return 本次消费的通知涉及 path 时返回1
+ */
+static int file_cache_drain_invalidations_locked(const char* path) {
+    invalidation_queue_t* queue = &invalidation_queue;
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    int matched = 0;
+
+    while (tail != head) {
+        const invalidation_t* item = &queue->items[tail % INVALIDATION_QUEUE_SIZE];
+        size_t item_len = strlen(item->path);
+
+        file_cache_remove_locked(item->path, item->is_directory);
+        if (path && strncmp(path, item->path, item_len) == 0 &&
+            (path[item_len] == '\0' || (item->is_directory && path[item_len] == '/'))) {
+            matched = 1;
+        }
+        tail++;
+    }
+    atomic_store_explicit(&queue->tail, tail, memory_order_release);
+
+    // 队列溢出意味着丢失了通知，只能整体清空
+    if (atomic_exchange_explicit(&queue->overflowed, 0, memory_order_acq_rel)) {
+        file_cache_remove_locked("", 1);
+        matched = 1;
+    }
+    return matched;
+}
+
+/**
+ * 监视规则：跳过以 . 开头的目录、符号链接（不跟随）和放不进 paths 表的长路径
+ * 目录遍历、新建目录事件与文件缓存共用这一规则
+ * @param dir_path 目录路径（"." 或 "./a/b"）
+ * @return 应当监视返回1
+ */
+static int file_watcher_should_watch(const char* dir_path) {
+    const char* name = strrchr(dir_path, '/');
+    struct stat st;
+
+    name = name ? name + 1 : dir_path;
+    if (strlen(dir_path) >= sizeof(file_watcher.paths[0])) {
+        return 0;
+    }
+    if (name[0] == '.' && strcmp(dir_path, ".") != 0) {
+        return 0;
+    }
+    return lstat(dir_path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * 判断文件的变更能否经 inotify 得知：文件本身不是符号链接，且各级父目录都符合监视规则
+ * @param local_path 本地文件路径（"./a/b.txt"）
+ */
+static int file_cache_path_watched(const char* local_path) {
+    char dir[256];
+    struct stat st;
+
+    if (lstat(local_path, &st) != 0 || S_ISLNK(st.st_mode)) {
+        return 0;
+    }
+    for (const char* slash = strchr(local_path + 2, '/'); slash; slash = strchr(slash + 1, '/')) {
+        size_t len = (size_t)(slash - local_path);
+        if (len >= sizeof(dir)) {
+            return 0;
+        }
+        memcpy(dir, local_path, len);
+        dir[len] = '\0';
+        if (!file_watcher_should_watch(dir)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 获取文件的缓存描述符与元数据
+ * inotify 生效时命中不产生任何系统调用；回退模式下命中需要一次 stat 校验 mtime
+ * @param local_path 本地文件路径
+ * @param status 失败时写入 HTTP 状态码
+ * @return 持有一个引用的条目，用完调用 file_cache_release；失败返回 NULL
+ */
+file_cache_entry_t* file_cache_acquire(const char* local_path, int* status) {
+    uint32_t start = file_cache_hash(local_path);
+    int validate = !atomic_load_explicit(&file_cache.watching, memory_order_acquire);
+    file_cache_entry_t* entry = NULL;
+    file_cache_entry_t** victim = NULL;
+    struct stat st;
+    int fd;
+
+    pthread_mutex_lock(&file_cache.lock);
+    file_cache_drain_invalidations_locked(NULL);
+
+    for (int i = 0; i < FILE_CACHE_PROBE_WINDOW; ++i) {
+        file_cache_entry_t** slot = &file_cache.slots[(start + i) & (FILE_CACHE_SLOTS - 1)];
+        if (*slot && strcmp((*slot)->path, local_path) == 0) {
+            entry = *slot;
+            victim = slot;
+            break;
+        }
+    }
+
+    if (entry && (validate || entry->validate)) {
+        // 回退模式或不在监视范围内：校验文件是否在缓存后被修改或替换
+        if (stat(local_path, &st) != 0 || st.st_ino != entry->st.st_ino ||
+            st.st_mtim.tv_sec != entry->st.st_mtim.tv_sec || st.st_mtim.tv_nsec != entry->st.st_mtim.tv_nsec ||
+            st.st_size != entry->st.st_size) {
+            file_cache_release(entry);
+            *victim = NULL;
+            entry = NULL;
+        }
+    }
+
+    if (entry) {
+        entry->last_used = ++file_cache.clock;
+        atomic_fetch_add(&entry->refcount, 1);
+        pthread_mutex_unlock(&file_cache.lock);
+        return entry;
+    }
+    pthread_mutex_unlock(&file_cache.lock);
+
+    // 未命中：在锁外打开文件
+    fd = open(local_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) close(fd);
+        *status = 404;
+        return NULL;
+    }
+
+    entry = calloc(1, sizeof(file_cache_entry_t));
+    if (!entry) {
+        close(fd);
+        *status = 500;
+        return NULL;
+    }
+    snprintf(entry->path, sizeof(entry->path), "%s", local_path);
+    entry->fd = fd;
+    entry->st = st;
+    entry->validate = !file_cache_path_watched(local_path);
+    atomic_init(&entry->refcount, 2);  // 缓存表与调用方各持有一个引用
+
+    pthread_mutex_lock(&file_cache.lock);
+    if (file_cache_drain_invalidations_locked(local_path)) {
+        // 打开期间文件已变更，本次结果不进入缓存
+        pthread_mutex_unlock(&file_cache.lock);
+        atomic_store(&entry->refcount, 1);
+        return entry;
+    }
+    file_cache_remove_locked(local_path, 0);
+    // 重新选择槽位：锁外打开期间表可能已变化
+    victim = NULL;
+    for (int i = 0; i < FILE_CACHE_PROBE_WINDOW; ++i) {
+        file_cache_entry_t** slot = &file_cache.slots[(start + i) & (FILE_CACHE_SLOTS - 1)];
+        if (!*slot) {
+            victim = slot;
+            break;
+        }
+        if (!victim || (*slot)->last_used < (*victim)->last_used) {
+            victim = slot;
+        }
+    }
+    file_cache_release(*victim);
+    entry->last_used = ++file_cache.clock;
+    *victim = entry;
+    pthread_mutex_unlock(&file_cache.lock);
+
+    return entry;
+}
+
+/**
+ * 推送一条失效通知（仅由 inotify 线程调用，单生产者无锁队列）
+ */
+static void invalidation_push(const char* path, int is_directory) {
+    invalidation_queue_t* queue = &invalidation_queue;
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head - tail >= INVALIDATION_QUEUE_SIZE) {
+        atomic_store_explicit(&queue->overflowed, 1, memory_order_release);
+        return;
+    }
+
+    invalidation_t* item = &queue->items[head % INVALIDATION_QUEUE_SIZE];
+    snprintf(item->path, sizeof(item->path), "%s", path);
+    item->is_directory = is_directory;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+/**
+ * 递归监视目录；监视数量耗尽或监视失败时切换到 mtime 校验
+ * 目录在添加前已被删除（ENOENT）不影响其余监视
+ * @return 成功返回0，失败返回-1
+ */
+static int file_watcher_add_tree(const char* dir_path) {
+    DIR* dir;
+    struct dirent* entry;
+    struct stat st;
+    int wd;
+
+    if (file_watcher.watch_count >= FILE_WATCHER_MAX_WATCHES) {
+        errno = ENOSPC;
+        wd = -1;
+    } else {
+        wd = inotify_add_watch(file_watcher.inotify_fd, dir_path,
+                               IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    }
+    if (wd >= FILE_WATCHER_MAX_WATCHES) {
+        // 监视描述符超出映射表范围，按监视数量耗尽处理
+        inotify_rm_watch(file_watcher.inotify_fd, wd);
+        errno = ENOSPC;
+        wd = -1;
+    }
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            if (atomic_exchange(&file_cache.watching, 0)) {
+                log_message("WARN", "inotify watch limit reached after %d directories; "
+                            "file cache falls back to mtime validation", file_watcher.watch_count);
+            }
+            file_watcher.limit_exhausted = 1;
+        } else if (errno != ENOENT) {
+            // 未被监视的目录无法收到失效通知，整体回退到 mtime 校验
+            if (atomic_exchange(&file_cache.watching, 0)) {
+                log_message("WARN", "Failed to watch %s (%s); file cache falls back to mtime validation",
+                            dir_path, strerror(errno));
+            }
+            file_watcher.limit_exhausted = 1;
+        }
+        return -1;
+    }
+    // 同一目录（例如在树内移动后）会返回已有的监视描述符，不重复计数
+    if (file_watcher.paths[wd][0] == '\0') {
+        file_watcher.watch_count++;
+    }
+    snprintf(file_watcher.paths[wd], sizeof(file_watcher.paths[wd]), "%s", dir_path);
+    file_watcher.inodes[wd] = stat(dir_path, &st) == 0 ? st.st_ino : 0;
+
+    dir = opendir(dir_path);
+    if (!dir) {
+        return 0;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        char child[256];
+        // 类型未知的条目交给 file_watcher_should_watch 用 lstat 判断
+        if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+        if (snprintf(child, sizeof(child), "%s/%s", dir_path, entry->d_name) >= (int)sizeof(child) ||
+            !file_watcher_should_watch(child)) {
+            continue;
+        }
+        if (file_watcher_add_tree(child) != 0 && file_watcher.limit_exhausted) {
+            break;
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+/**
+ * inotify 线程：把变更转换为失效通知
+ */
+static void* file_watcher_main(void* arg) {
+    char buffer[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    (void)arg;
+    while (server_running) {
+        ssize_t len = read(file_watcher.inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) continue;
+            break;
+        }
+
+        for (char* p = buffer; p < buffer + len;) {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            char path[512];
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                atomic_store(&invalidation_queue.overflowed, 1);
+                atomic_fetch_add(&api_cache.generation, 1);
+                log_message("WARN", "inotify event queue overflowed, flushing file cache");
+                continue;
+            }
+            if (event->wd < 0 || event->wd >= FILE_WATCHER_MAX_WATCHES || file_watcher.paths[event->wd][0] == '\0') {
+                continue;
+            }
+
+            const char* dir_path = file_watcher.paths[event->wd];
+            if (event->mask & IN_IGNORED) {
+                // 监视已被内核移除（目录删除、rm_watch 或卸载），回收描述符
+                file_watcher.paths[event->wd][0] = '\0';
+                file_watcher.watch_count--;
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                struct stat st;
+                invalidation_push(dir_path, 1);
+                atomic_fetch_add(&api_cache.generation, 1);
+                // 移出原路径的目录不再对应任何缓存键；若已在树内新位置重新登记则保留
+                if ((event->mask & IN_MOVE_SELF) &&
+                    (stat(dir_path, &st) != 0 || st.st_ino != file_watcher.inodes[event->wd])) {
+                    inotify_rm_watch(file_watcher.inotify_fd, event->wd);
+                }
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+
+            snprintf(path, sizeof(path), "%s/%s", dir_path, event->name);
+            invalidation_push(path, (event->mask & IN_ISDIR) != 0);
+            atomic_fetch_add(&api_cache.generation, 1);
+
+            // 新建或移入的子目录同样需要监视
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+                !file_watcher.limit_exhausted && file_watcher_should_watch(path)) {
+                file_watcher_add_tree(path);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 启动 inotify 监视；失败时文件缓存保持 mtime 校验模式
+ * @param root 服务目录
+ * @return 监视生效返回0，否则返回-1
+ */
+int start_file_watcher(const char* root) {
+    pthread_t thread;
+
+    file_watcher.inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (file_watcher.inotify_fd < 0) {
+        log_message("WARN", "inotify unavailable (%s); file cache uses mtime validation", strerror(errno));
+        return -1;
+    }
+
+    // 先置为监视模式，添加监视时若数量耗尽或失败会被撤销
+    atomic_store(&file_cache.watching, 1);
+    if (file_watcher_add_tree(root) != 0) {
+        atomic_store(&file_cache.watching, 0);
+    }
+
+    if (pthread_create(&thread, NULL, file_watcher_main, NULL) != 0) {
+        atomic_store(&file_cache.watching, 0);
+        return -1;
+    }
+    pthread_detach(thread);
+
+    log_message("INFO", "Watching %d directories for cache invalidation%s", file_watcher.watch_count,
+                file_watcher.limit_exhausted ? " (limit reached, mtime fallback active)" : "");
+    return file_cache.watching ? 0 : -1;
+}
+
+#ifndef LITHE_NO_MAIN
+/**
+ * SIGUSR1：请求输出工作线程负载，由主循环处理
+ */
+static void request_worker_report(int signal) {
+    (void)signal;
+    worker_report_requested = 1;
+}
+
+/**
+ * SIGINT/SIGTERM：只置退出标志，清理（输出负载、写出访问日志）在主循环退出后进行，
+ * 避免在信号处理函数里争用工作线程持有的锁
+ */
+static void request_shutdown(int signal) {
+    (void)signal;
+    server_running = 0;
+}
+
+/**
+ * SIGUSR2：请求平滑升级，由主循环处理
+ */
+static void request_upgrade(int signal) {
+    (void)signal;
+    upgrade_requested = 1;
+}
+
+// ---------- 平滑升级 ----------
+//
+// 旧进程 fork 并重新执行（可能已被替换的）程序文件，经 socketpair 以 SCM_RIGHTS 传递监听套接字；
+// 新进程启动工作线程后回写一个字节表示就绪。监听套接字（连同内核中的积压队列）始终有进程持有，
+// 升级期间不会拒绝连接。旧进程收到就绪通知后停止接受连接，等待在途连接处理完毕再退出。
+
+/**
+ * 新进程：从移交通道接收旧进程的监听套接字
+ * @param tcp_fd 输出 TCP 监听套接字，未移交为 -1
+ * @param unix_fd 输出 Unix 域监听套接字，未移交为 -1
+ * @return 移交通道（就绪后经它通知旧进程）；不是升级启动返回 -1，接收失败返回 -2
+ */
+static int upgrade_receive_listeners(int* tcp_fd, int* unix_fd) {
+    const char* env = getenv(UPGRADE_ENV);
+    upgrade_message_t message;
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct iovec iov = { &message, sizeof(message) };
+    struct msghdr msg = { 0 };
+    int fds[2] = { -1, -1 };
+    int channel;
+
+    *tcp_fd = -1;
+    *unix_fd = -1;
+    if (!env) {
+        return -1;
+    }
+    channel = atoi(env);
+    unsetenv(UPGRADE_ENV);
+    fcntl(channel, F_SETFD, FD_CLOEXEC);
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    if (recvmsg(channel, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(message) ||
+        memcmp(message.magic, UPGRADE_MAGIC, sizeof(message.magic)) != 0) {
+        fprintf(stderr, "Failed to receive listening sockets from the previous process\n");
+        close(channel);
+        return -2;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(fds, CMSG_DATA(cmsg), cmsg->cmsg_len - CMSG_LEN(0));
+        }
+    }
+
+    int next = 0;
+    if (message.has_tcp) {
+        *tcp_fd = fds[next++];
+    }
+    if (message.has_unix) {
+        *unix_fd = fds[next++];
+    }
+    return channel;
+}
+
+/**
+ * 旧进程：启动新进程并移交监听套接字，新进程就绪前照常接受连接
+ */
+static void upgrade_start(void) {
+    extern char** environ;
+    static char channel_env[32];
+    upgrade_message_t message = { .has_tcp = server_socket >= 0, .has_unix = unix_server_socket >= 0 };
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct iovec iov = { &message, sizeof(message) };
+    struct msghdr msg = { 0 };
+    int fds[2];
+    int fd_count = 0;
+    size_t env_count = 0;
+    char** envp;
+    int pair[2];
+    pid_t pid;
+
+    if (upgrade_channel >= 0) {
+        log_message("WARN", "Upgrade already in progress (pid %d)", (int)upgrade_pid);
+        return;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0) {
+        log_message("ERROR", "Upgrade failed: socketpair: %s", strerror(errno));
+        return;
+    }
+
+    // fork 之后子进程只调用异步信号安全的函数，环境变量预先构造好
+    while (environ[env_count]) {
+        ++env_count;
+    }
+    envp = malloc((env_count + 2) * sizeof(char*));
+    if (!envp) {
+        close(pair[0]);
+        close(pair[1]);
+        return;
+    }
+    env_count = 0;
+    for (char** env = environ; *env; ++env) {
+        if (strncmp(*env, UPGRADE_ENV "=", sizeof(UPGRADE_ENV)) != 0) {
+            envp[env_count++] = *env;
+        }
+    }
+    snprintf(channel_env, sizeof(channel_env), "%s=%d", UPGRADE_ENV, UPGRADE_CHANNEL_FD);
+    envp[env_count++] = channel_env;
+    envp[env_count] = NULL;
+
+    pid = fork();
+    if (pid == 0) {
+        // 子进程：通道固定到 3 号描述符，其余继承的描述符（客户端连接、inotify 等）一律关闭
+        sigset_t none;
+        if (pair[1] == UPGRADE_CHANNEL_FD) {
+            fcntl(UPGRADE_CHANNEL_FD, F_SETFD, 0);
+        } else if (dup2(pair[1], UPGRADE_CHANNEL_FD) < 0) {
+            _exit(127);
+        }
+        close_range(UPGRADE_CHANNEL_FD + 1, ~0U, 0);
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        execve(exec_path, saved_argv, envp);
+        _exit(127);
+    }
+    free(envp);
+    close(pair[1]);
+    if (pid < 0) {
+        log_message("ERROR", "Upgrade failed: fork: %s", strerror(errno));
+        close(pair[0]);
+        return;
+    }
+
+    memcpy(message.magic, UPGRADE_MAGIC, sizeof(message.magic));
+    if (server_socket >= 0) {
+        fds[fd_count++] = server_socket;
+    }
+    if (unix_server_socket >= 0) {
+        fds[fd_count++] = unix_server_socket;
+    }
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = CMSG_SPACE(fd_count * sizeof(int));
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fd_count * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, fd_count * sizeof(int));
+    if (sendmsg(pair[0], &msg, 0) != (ssize_t)sizeof(message)) {
+        // 新进程收不到套接字会自行退出
+        log_message("ERROR", "Upgrade failed: sendmsg: %s", strerror(errno));
+        close(pair[0]);
+        waitpid(pid, NULL, 0);
+        return;
+    }
+
+    upgrade_channel = pair[0];
+    upgrade_pid = pid;
+    upgrade_deadline_ns = monotonic_ns() + UPGRADE_READY_TIMEOUT_MS * 1000000LL;
+    log_message("INFO", "Started %s as pid %d, waiting for it to become ready", exec_path, (int)pid);
+}
+
+/**
+ * 检查新进程是否就绪（通道可读或等待超时时调用）
+ * @param readable 通道是否可读
+ * @return 新进程已接管返回1；仍在等待或升级失败返回0（失败时旧进程继续服务）
+ */
+static int upgrade_check_ready(int readable) {
+    char ready = 0;
+
+    if (readable && read(upgrade_channel, &ready, 1) == 1 && ready == 'R') {
+        log_message("INFO", "New process %d is accepting connections, draining", (int)upgrade_pid);
+        close(upgrade_channel);
+        upgrade_channel = -1;
+        return 1;
+    }
+    if (!readable && monotonic_ns() < upgrade_deadline_ns) {
+        return 0;
+    }
+
+    log_message("ERROR", "Upgrade failed: new process %d %s, keeping the current one", (int)upgrade_pid,
+                readable ? "exited before becoming ready" : "did not become ready in time");
+    kill(upgrade_pid, SIGKILL);
+    waitpid(upgrade_pid, NULL, 0);
+    close(upgrade_channel);
+    upgrade_channel = -1;
+    upgrade_pid = 0;
+    return 0;
+}
+
+/**
+ * 停止接受连接后等待在途连接处理完毕，最多等待 seconds 秒；期间再次收到退出信号则立即结束
+ */
+static void drain_connections(int seconds) {
+    int64_t deadline_ns = monotonic_ns() + seconds * 1000000000LL;
+    int remaining;
+
+    struct timespec interval = { 0, 20000000 };
+
+    while ((remaining = atomic_load(&connections_in_flight)) > 0 && server_running &&
+           monotonic_ns() < deadline_ns) {
+        ppoll(NULL, 0, &interval, &main_wait_mask);
+    }
+    if (remaining > 0) {
+        log_message("WARN", "Exiting with %d connections still in flight", remaining);
+    } else {
+        log_message("INFO", "All connections drained");
+    }
+}
+
+/**
+ * 接受一个就绪的连接并交给工作线程
+ * TCP 连接按 IP 限制并发；Unix 域连接读取 SO_PEERCRED 作为对端身份
+ * @param listen_fd 就绪的监听套接字（非阻塞）
+ */
+static void accept_connection(int listen_fd) {
+    pending_connection_t pending;
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    int client_socket;
+
+    client_socket = accept(listen_fd, (struct sockaddr*)&addr, &addr_len);
+    if (client_socket < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+            perror("accept failed");
+        }
+        return;
+    }
+
+    memset(&pending, 0, sizeof(pending));
+    pending.socket_fd = client_socket;
+    pending.timing.accept_ns = monotonic_ns();
+
+    if (listen_fd == unix_server_socket) {
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(client_socket, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+            log_message("ERROR", "SO_PEERCRED failed: %s", strerror(errno));
+            close(client_socket);
+            return;
+        }
+        pending.peer.valid = 1;
+        pending.peer.pid = cred.pid;
+        pending.peer.uid = cred.uid;
+        pending.peer.gid = cred.gid;
+        pending.addr.sin_family = AF_UNIX;
+        LITHE_PROBE2(accept, client_socket, 0);
+    } else {
+        memcpy(&pending.addr, &addr, sizeof(pending.addr));
+        LITHE_PROBE2(accept, client_socket, pending.addr.sin_addr.s_addr);
+
+        // 单 IP 并发连接超限时直接返回 429
+        if (rate_limit_acquire_connection(pending.addr.sin_addr.s_addr) != 0) {
+            send_too_many_requests(client_socket, 1);
+            close(client_socket);
+            return;
+        }
+    }
+
+    // 交给工作线程处理，队列已满时直接返回 503
+    atomic_fetch_add(&connections_in_flight, 1);
+    if (dispatch_connection(&pending) != 0) {
+        atomic_fetch_sub(&connections_in_flight, 1);
+        send_service_unavailable(client_socket);
+        close(client_socket);
+        if (!pending.peer.valid) {
+            rate_limit_release_connection(pending.addr.sin_addr.s_addr);
+        }
+    }
+}
+
+/**
+ * 主函数
+ */
+int main(int argc, char* argv[]) {
+    int port = DEFAULT_PORT;
+    int enable_tcp = 1;
+    const char* unix_path = NULL;
+    int unix_mode = -1;
+    const char* access_log_path = NULL;
+    struct sigaction signal_action;
+    sigset_t handled_signals;
+    int inherited_tcp;
+    int inherited_unix;
+    int upgrade_notify;
+    int handed_off = 0;
+    
+    // 解析命令行参数：[端口] [--pin-workers] [--slow-ms 毫秒]
+    //               [--unix 路径|@抽象名] [--unix-mode 八进制权限] [--no-tcp]
+    //               [--upstream host:port|unix:路径] [--access-log 文件] [--api-cache-ms 毫秒]
+    //               [--drain-seconds 秒]
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--pin-workers") == 0) {
+            pin_workers = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--slow-ms") == 0 && i + 1 < argc) {
+            slow_request_threshold_ns = atoll(argv[++i]) * 1000000LL;
+            continue;
+        }
+        if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            unix_path = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--unix-mode") == 0 && i + 1 < argc) {
+            unix_mode = (int)strtol(argv[++i], NULL, 8);
+            continue;
+        }
+        if (strcmp(argv[i], "--no-tcp") == 0) {
+            enable_tcp = 0;
+            continue;
+        }
+        if (strcmp(argv[i], "--drain-seconds") == 0 && i + 1 < argc) {
+            drain_seconds = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--api-cache-ms") == 0 && i + 1 < argc) {
+            api_cache_ttl_ns = atoll(argv[++i]) * 1000000LL;
+            continue;
+        }
+        if (strcmp(argv[i], "--access-log") == 0 && i + 1 < argc) {
+            access_log_path = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--upstream") == 0 && i + 1 < argc) {
+            if (upstream_configure(argv[++i]) != 0) {
+                fprintf(stderr, "Invalid upstream address: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        port = atoi(argv[i]);
+        if (port <= 0 || port > 65535) {
+            fprintf(stderr, "Invalid port number: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!enable_tcp && !unix_path) {
+        fprintf(stderr, "--no-tcp requires --unix\n");
+        return EXIT_FAILURE;
+    }
+    
+    // 升级时重新执行同一路径（部署替换文件后即为新版本）与同一组参数
+    saved_argv = argv;
+    if (strchr(argv[0], '/')) {
+        snprintf(exec_path, sizeof(exec_path), "%s", argv[0]);
+    } else {
+        ssize_t len = readlink("/proc/self/exe", exec_path, sizeof(exec_path) - 1);
+        exec_path[len > 0 ? len : 0] = '\0';
+    }
+    
+    // 由旧进程升级启动时沿用其监听套接字
+    upgrade_notify = upgrade_receive_listeners(&inherited_tcp, &inherited_unix);
+    if (upgrade_notify == -2) {
+        return EXIT_FAILURE;
+    }
+    
+    // 设置信号处理：退出、SIGUSR1（输出工作线程负载）与 SIGUSR2（平滑升级）都只置标志，
+    // ppoll 返回 EINTR 后由主循环处理
+    signal(SIGPIPE, SIG_IGN);
+    memset(&signal_action, 0, sizeof(signal_action));
+    sigemptyset(&signal_action.sa_mask);
+    signal_action.sa_handler = request_shutdown;
+    sigaction(SIGINT, &signal_action, NULL);
+    sigaction(SIGTERM, &signal_action, NULL);
+    signal_action.sa_handler = request_worker_report;
+    sigaction(SIGUSR1, &signal_action, NULL);
+    signal_action.sa_handler = request_upgrade;
+    sigaction(SIGUSR2, &signal_action, NULL);
+    
+    // 上述信号在所有线程中屏蔽，只在主线程的 ppoll 期间解除：
+    // 忙于接受连接时到达的信号不会丢失，下一次 ppoll 必定以 EINTR 返回
+    sigemptyset(&handled_signals);
+    sigaddset(&handled_signals, SIGINT);
+    sigaddset(&handled_signals, SIGTERM);
+    sigaddset(&handled_signals, SIGUSR1);
+    sigaddset(&handled_signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &handled_signals, &main_wait_mask);
+    
+    // 创建服务器套接字（TCP 和/或 Unix 域），均设为非阻塞，由同一个 poll 循环接受
+    server_start_time = time(NULL);
+    if (inherited_tcp >= 0 && !enable_tcp) {
+        close(inherited_tcp);
+    } else if (inherited_tcp >= 0) {
+        server_socket = inherited_tcp;
+        log_message("INFO", "Inherited TCP listener from the previous process");
+    } else if (enable_tcp) {
+        server_socket = create_server_socket(port);
+        if (server_socket < 0) {
+            fprintf(stderr, "Failed to create server socket\n");
+            return EXIT_FAILURE;
+        }
+        fcntl(server_socket, F_SETFL, fcntl(server_socket, F_GETFL) | O_NONBLOCK);
+    }
+    if (inherited_unix >= 0 && !unix_path) {
+        close(inherited_unix);
+    } else if (inherited_unix >= 0) {
+        unix_server_socket = inherited_unix;
+        if (unix_path[0] != '@') {
+            snprintf(unix_socket_path, sizeof(unix_socket_path), "%s", unix_path);
+        }
+        log_message("INFO", "Inherited unix listener from the previous process");
+    } else if (unix_path) {
+        unix_server_socket = create_unix_server_socket(unix_path, unix_mode);
+        if (unix_server_socket < 0) {
+            fprintf(stderr, "Failed to create unix server socket\n");
+            cleanup_and_exit(0);
+            return EXIT_FAILURE;
+        }
+        fcntl(unix_server_socket, F_SETFL, fcntl(unix_server_socket, F_GETFL) | O_NONBLOCK);
+    }
+    
+    // 二进制访问日志
+    if (access_log_path && access_log_open(access_log_path) != 0) {
+        cleanup_and_exit(0);
+        return EXIT_FAILURE;
+    }
+    
+    // 监视服务目录，文件缓存命中无需再 stat
+    start_file_watcher(".");
+    
+    // 启动工作线程池
+    if (start_workers() != 0) {
+        cleanup_and_exit(0);
+        return EXIT_FAILURE;
+    }
+    
+    // 通知旧进程：已可以接受连接
+    if (upgrade_notify >= 0) {
+        if (write(upgrade_notify, "R", 1) != 1) {
+            log_message("WARN", "Failed to notify the previous process: %s", strerror(errno));
+        }
+        close(upgrade_notify);
+    }
+    
+    printf("🚀 LitheServer started successfully!\n");
+    printf("📁 Serving files from current directory\n");
+    if (enable_tcp) {
+        printf("🌐 Server listening on http://localhost:%d\n", port);
+    }
+    if (unix_path) {
+        printf("🔌 Server listening on unix:%s\n", unix_path);
+    }
+    printf("💡 Press Ctrl+C to stop the server\n\n");
+    fflush(stdout);
+    
+    // 主循环：等待任一监听套接字就绪并接受连接；升级期间同时等待新进程的就绪通知
+    while (server_running && !handed_off) {
+        struct pollfd fds[3];
+        int nfds = 0;
+        int ready;
+        struct timespec upgrade_poll_interval = { 0, 100000000 };
+        
+        if (server_socket >= 0) {
+            fds[nfds].fd = server_socket;
+            fds[nfds++].events = POLLIN;
+        }
+        if (unix_server_socket >= 0) {
+            fds[nfds].fd = unix_server_socket;
+            fds[nfds++].events = POLLIN;
+        }
+        
+        if (upgrade_channel >= 0) {
+            fds[nfds].fd = upgrade_channel;
+            fds[nfds++].events = POLLIN;
+        }
+        
+        ready = ppoll(fds, nfds, upgrade_channel >= 0 ? &upgrade_poll_interval : NULL, &main_wait_mask);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                if (worker_report_requested) {
+                    worker_report_requested = 0;
+                    report_worker_load();
+                }
+                if (upgrade_requested) {
+                    upgrade_requested = 0;
+                    upgrade_start();
+                }
+                continue;  // 被信号中断，继续循环
+            }
+            perror("poll failed");
+            break;
+        }
+        if (upgrade_channel >= 0) {
+            int readable = (fds[nfds - 1].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+            --nfds;
+            if (upgrade_check_ready(readable)) {
+                handed_off = 1;
+                break;
+            }
+        }
+        
+        for (int i = 0; i < nfds; ++i) {
+            if (fds[i].revents & POLLIN) {
+                accept_connection(fds[i].fd);
+            }
+        }
+    }
+    
+    // 新进程已接管监听套接字：关闭本进程的副本（不删除 Unix 套接字文件），排空后退出
+    if (handed_off) {
+        close(server_socket);
+        server_socket = -1;
+        if (unix_server_socket >= 0) {
+            unix_socket_path[0] = '\0';
+            close(unix_server_socket);
+            unix_server_socket = -1;
+        }
+        drain_connections(drain_seconds);
+    }
+    
+    cleanup_and_exit(0);
+    return EXIT_SUCCESS;
+}
+#endif /* LITHE_NO_MAIN */
+
+/**
+ * 清理并退出
+ * @param signal 信号值
+ */
+void cleanup_and_exit(int signal) {
+    server_running = 0;
+    
+    if (server_socket >= 0) {
+        close(server_socket);
+        server_socket = -1;
+    }
+    if (unix_server_socket >= 0) {
+        close(unix_server_socket);
+        unix_server_socket = -1;
+        if (unix_socket_path[0]) {
+            unlink(unix_socket_path);
+        }
     }
     
+    report_worker_load();
+    access_log_flush();
     printf("\n👋 LitheServer stopped gracefully.\n");
     
     if (signal != 0) {
@@ -2,6 +2,9 @@
  * C++ 语法高亮测试文件
  * 演示现代 C++ (C++11/14/17/20) 特性
  * 
+ * 编译：g++ -std=c++20 -O2 -pthread example.cpp -ltbb
+ * （libstdc++ 的 std::execution 并行算法以 TBB 为后端）
+ * 
  * @author xyanmi
  * @date 2025-06-01
  */
@@ -10,53 +13,359 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <functional>
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <bit>
+#include <new>
 #include <future>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
 #include <chrono>
 #include <optional>
 #include <variant>
 #include <type_traits>
 #include <concepts>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <ranges>
+#include <iterator>
+#include <execution>
+#include <numeric>
+#include <utility>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <unistd.h>
 
 // 命名空间
 namespace LitheServer {
 
-// 模板类
+// ---------- SmartArray 策略 ----------
+
+// 可按字节搬移的类型：增长时可以直接 realloc / mremap，无需逐个移动构造
+// 默认取平凡可拷贝类型，其他确认安全的类型可以特化
+template<typename T>
+struct is_trivially_relocatable : std::bool_constant<std::is_trivially_copyable_v<T>> {};
+
+template<typename T>
+inline constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+// 分配器策略：allocate / deallocate 管理未初始化的原始内存；
+// 可选的 reallocate 用于可按字节搬移的类型，无法原地或廉价扩容时返回 nullptr
+template<typename A>
+concept ArrayAllocator = requires(A a, void* p, size_t n) {
+    { a.allocate(n, n) } -> std::same_as<void*>;
+    a.deallocate(p, n, n);
+};
+
+template<typename A>
+concept ReallocatingAllocator = ArrayAllocator<A> && requires(A a, void* p, size_t n) {
+    { a.reallocate(p, n, n, n) } -> std::same_as<void*>;
+};
+
+// malloc 系列：大块 realloc 在 glibc 中由 mremap 完成，不拷贝数据
+struct MallocAllocator {
+    void* allocate(size_t bytes, size_t align) {
+        void* p = align <= alignof(std::max_align_t)
+            ? std::malloc(bytes)
+            : std::aligned_alloc(align, (bytes + align - 1) / align * align);
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+    void deallocate(void* p, size_t, size_t) noexcept { std::free(p); }
+    void* reallocate(void* p, size_t, size_t new_bytes, size_t align) noexcept {
+        return align <= alignof(std::max_align_t) ? std::realloc(p, new_bytes) : nullptr;
+    }
+};
+
+// 单调内存区：只追加分配，整体随 Arena 释放；最后一次分配可以原地扩容
+class Arena {
+private:
+    std::unique_ptr<unsigned char[]> buffer_;
+    size_t capacity_;
+    size_t used_ = 0;
+    void* last_ = nullptr;
+
+public:
+    explicit Arena(size_t capacity)
+        : buffer_(new unsigned char[capacity]), capacity_(capacity) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t align) {
+        size_t offset = (used_ + align - 1) / align * align;
+        if (offset > capacity_ || bytes > capacity_ - offset) {
+            throw std::bad_alloc();
+        }
+        used_ = offset + bytes;
+        return last_ = buffer_.get() + offset;
+    }
+
+    void* extend(void* p, size_t new_bytes) noexcept {
+        size_t offset = static_cast<unsigned char*>(p) - buffer_.get();
+        if (p != last_ || new_bytes > capacity_ - offset) {
+            return nullptr;
+        }
+        used_ = offset + new_bytes;
+        return p;
+    }
+
+    [[nodiscard]] size_t used() const noexcept { return used_; }
+};
+
+// 引用外部 Arena 的分配器句柄
+class ArenaAllocator {
+private:
+    Arena* arena_;
+
+public:
+    explicit ArenaAllocator(Arena& arena) noexcept : arena_(&arena) {}
+
+    void* allocate(size_t bytes, size_t align) { return arena_->allocate(bytes, align); }
+    void deallocate(void*, size_t, size_t) noexcept {}
+    void* reallocate(void* p, size_t, size_t new_bytes, size_t) noexcept { return arena_->extend(p, new_bytes); }
+};
+
+// 按 2 的幂分级的线程本地空闲链表，适合大量生命周期短的小数组；超过 64KB 直接用 malloc
+class PoolAllocator {
+private:
+    static constexpr size_t kMinClassBits = 6;    // 64B
+    static constexpr size_t kMaxClassBits = 16;   // 64KB
+
+    struct FreeBlock { FreeBlock* next; };
+
+    struct FreeLists {
+        FreeBlock* heads[kMaxClassBits - kMinClassBits + 1] = {};
+        ~FreeLists() {
+            for (FreeBlock* head : heads) {
+                while (head) {
+                    FreeBlock* next = head->next;
+                    std::free(head);
+                    head = next;
+                }
+            }
+        }
+    };
+
+    static FreeLists& free_lists() {
+        thread_local FreeLists lists;
+        return lists;
+    }
+
+    static size_t class_of(size_t bytes) noexcept {
+        size_t bits = static_cast<size_t>(std::bit_width(std::max(bytes, size_t{1} << kMinClassBits) - 1));
+        return bits - kMinClassBits;
+    }
+
+public:
+    void* allocate(size_t bytes, size_t align) {
+        if (bytes > (size_t{1} << kMaxClassBits) || align > alignof(std::max_align_t)) {
+            return MallocAllocator().allocate(bytes, align);
+        }
+        size_t cls = class_of(bytes);
+        FreeBlock*& head = free_lists().heads[cls];
+        if (FreeBlock* block = head) {
+            head = block->next;
+            return block;
+        }
+        return MallocAllocator().allocate(size_t{1} << (cls + kMinClassBits), align);
+    }
+
+    void deallocate(void* p, size_t bytes, size_t align) noexcept {
+        if (bytes > (size_t{1} << kMaxClassBits) || align > alignof(std::max_align_t)) {
+            std::free(p);
+            return;
+        }
+        FreeBlock*& head = free_lists().heads[class_of(bytes)];
+        head = ::new (p) FreeBlock{head};
+    }
+};
+
+// 匿名映射：2MB 以上的映射建议内核使用透明大页，扩容用 mremap 只移动页表
+struct HugePageAllocator {
+    static constexpr size_t kHugePageSize = size_t{2} << 20;
+
+    static size_t mapping_size(size_t bytes) noexcept {
+        static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return (std::max(bytes, size_t{1}) + page - 1) / page * page;
+    }
+
+    void* allocate(size_t bytes, size_t) {
+        size_t length = mapping_size(bytes);
+        void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        if (length >= kHugePageSize) {
+            madvise(p, length, MADV_HUGEPAGE);
+        }
+        return p;
+    }
+
+    void deallocate(void* p, size_t bytes, size_t) noexcept { munmap(p, mapping_size(bytes)); }
+
+    void* reallocate(void* p, size_t old_bytes, size_t new_bytes, size_t) noexcept {
+        size_t length = mapping_size(new_bytes);
+        void* q = mremap(p, mapping_size(old_bytes), length, MREMAP_MAYMOVE);
+        if (q == MAP_FAILED) {
+            return nullptr;
+        }
+        if (length >= kHugePageSize) {
+            madvise(q, length, MADV_HUGEPAGE);
+        }
+        return q;
+    }
+};
+
+// 增长策略：给出当前容量与所需最小容量，返回新容量
+struct DoublingGrowth {
+    static size_t next(size_t current, size_t required) noexcept {
+        return std::max(required, current * 2);
+    }
+};
+
+struct GoldenGrowth {
+    static size_t next(size_t current, size_t required) noexcept {
+        return std::max(required, current + current / 2 + 1);
+    }
+};
+
+template<size_t Step>
+struct LinearGrowth {
+    static_assert(Step > 0, "LinearGrowth step must be positive");
+    static size_t next(size_t current, size_t required) noexcept {
+        return std::max(required, current + Step);
+    }
+};
+
+// 加锁策略：写操作取独占锁，读操作取共享锁；NoLock 为空类型，不占空间也不产生任何指令
+struct NoLock {
+    void lock() noexcept {}
+    void unlock() noexcept {}
+    void lock_shared() noexcept {}
+    void unlock_shared() noexcept {}
+};
+
+class MutexLock {
+private:
+    std::mutex mutex_;
+
+public:
+    void lock() { mutex_.lock(); }
+    void unlock() { mutex_.unlock(); }
+    void lock_shared() { mutex_.lock(); }
+    void unlock_shared() { mutex_.unlock(); }
+};
+
+// 临界区很短时比互斥量便宜，避免线程挂起
+class SpinLock {
+private:
+    std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+
+public:
+    void lock() noexcept {
+        while (flag_.test_and_set(std::memory_order_acquire)) {
+            while (flag_.test(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    void unlock() noexcept { flag_.clear(std::memory_order_release); }
+    void lock_shared() noexcept { lock(); }
+    void unlock_shared() noexcept { unlock(); }
+};
+
+class SharedLock {
+private:
+    std::shared_mutex mutex_;
+
+public:
+    void lock() { mutex_.lock(); }
+    void unlock() { mutex_.unlock(); }
+    void lock_shared() { mutex_.lock_shared(); }
+    void unlock_shared() { mutex_.unlock_shared(); }
+};
+
+// 对象内的未初始化存储，N 为 0 时是空类型
+template<typename T, size_t N>
+struct InlineStorage {
+    alignas(T) unsigned char bytes[N * sizeof(T)];
+
+    T* get() noexcept { return reinterpret_cast<T*>(bytes); }
+};
+
 template<typename T>
+struct InlineStorage<T, 0> {
+    T* get() noexcept { return nullptr; }
+};
+
+// 模板类：前 N 个元素存放在对象内部，超出后才转移到分配器的存储上
+template<typename T,
+         size_t N = 0,
+         ArrayAllocator Alloc = MallocAllocator,
+         typename Growth = DoublingGrowth,
+         typename Lock = MutexLock>
 class SmartArray {
 private:
-    std::unique_ptr<T[]> data_;
+    T* data_;
     size_t size_;
     size_t capacity_;
-    mutable std::mutex mutex_;
+    [[no_unique_address]] InlineStorage<T, N> inline_;
+    [[no_unique_address]] Alloc alloc_;
+    [[no_unique_address]] mutable Lock lock_;
+
+    using write_guard = std::lock_guard<Lock>;
+    using read_guard = std::shared_lock<Lock>;
 
 public:
-    // 构造函数
-    explicit SmartArray(size_t initial_capacity = 10) 
-        : data_(std::make_unique<T[]>(initial_capacity))
+    // 构造函数：只分配未初始化的存储，不构造任何元素；不超过 N 时不分配
+    explicit SmartArray(size_t initial_capacity = N > 0 ? N : 10, Alloc alloc = Alloc())
+        : data_(nullptr)
         , size_(0)
-        , capacity_(initial_capacity) {}
+        , capacity_(N)
+        , alloc_(std::move(alloc)) {
+        data_ = inline_.get();
+        if (initial_capacity > N) {
+            data_ = static_cast<T*>(alloc_.allocate(bytes_for(initial_capacity), alignof(T)));
+            capacity_ = initial_capacity;
+        }
+    }
     
-    // 移动构造函数
-    SmartArray(SmartArray&& other) noexcept 
-        : data_(std::move(other.data_))
-        , size_(other.size_)
-        , capacity_(other.capacity_) {
-        other.size_ = 0;
-        other.capacity_ = 0;
+    // 移动构造函数：堆上的存储直接接管，对象内的元素逐个移动
+    SmartArray(SmartArray&& other) noexcept(N == 0 || std::is_nothrow_move_constructible_v<T>)
+        : data_(nullptr)
+        , size_(0)
+        , capacity_(N)
+        , alloc_(other.alloc_) {
+        data_ = inline_.get();
+        take(other);
     }
     
     // 移动赋值操作符
-    SmartArray& operator=(SmartArray&& other) noexcept {
+    SmartArray& operator=(SmartArray&& other) noexcept(N == 0 || std::is_nothrow_move_constructible_v<T>) {
         if (this != &other) {
-            data_ = std::move(other.data_);
-            size_ = other.size_;
-            capacity_ = other.capacity_;
-            other.size_ = 0;
-            other.capacity_ = 0;
+            release();
+            alloc_ = other.alloc_;
+            take(other);
         }
         return *this;
     }
@@ -66,29 +375,64 @@ public:
     SmartArray& operator=(const SmartArray&) = delete;
     
     // 析构函数
-    ~SmartArray() = default;
+    ~SmartArray() { release(); }
     
     // 添加元素
     void push_back(const T& item) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (size_ >= capacity_) {
-            resize(capacity_ * 2);
-        }
-        data_[size_++] = item;
+        emplace_back(item);
     }
     
-    // 完美转发版本
+    void push_back(T&& item) {
+        emplace_back(std::move(item));
+    }
+    
+    // 完美转发版本：直接在未初始化的槽位上构造
     template<typename... Args>
     void emplace_back(Args&&... args) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (size_ >= capacity_) {
-            resize(capacity_ * 2);
+        write_guard lock(lock_);
+        emplace_unlocked(std::forward<Args>(args)...);
+    }
+    
+    // 批量追加：长度可知的范围只扩容一次，平凡类型的连续范围直接 memcpy
+    template<std::ranges::input_range R>
+    void append_range(R&& range) {
+        write_guard lock(lock_);
+        append_unlocked(std::forward<R>(range));
+    }
+    
+    // 用范围的内容替换全部元素
+    template<std::ranges::input_range R>
+    void assign(R&& range) {
+        write_guard lock(lock_);
+        if constexpr (contiguous_range_of_t<R>) {
+            if (overlaps(range)) {
+                std::vector<T> copy(std::ranges::begin(range), std::ranges::end(range));
+                destroy_elements();
+                append_unlocked(copy);
+                return;
+            }
+        }
+        destroy_elements();
+        append_unlocked(std::forward<R>(range));
+    }
+    
+    // 预留容量，元素不变
+    void reserve(size_t new_capacity) {
+        write_guard lock(lock_);
+        if (new_capacity > capacity_) {
+            reallocate(new_capacity);
         }
-        data_[size_++] = T(std::forward<Args>(args)...);
+    }
+    
+    // 销毁全部元素，保留容量
+    void clear() noexcept {
+        write_guard lock(lock_);
+        destroy_elements();
     }
     
     // 访问元素
     T& operator[](size_t index) {
+        read_guard lock(lock_);
         if (index >= size_) {
             throw std::out_of_range("Index out of range");
         }
@@ -96,6 +440,7 @@ public:
     }
     
     const T& operator[](size_t index) const {
+        read_guard lock(lock_);
         if (index >= size_) {
             throw std::out_of_range("Index out of range");
         }
@@ -104,42 +449,411 @@ public:
     
     // 获取大小
     [[nodiscard]] size_t size() const noexcept { 
-        std::lock_guard<std::mutex> lock(mutex_);
+        read_guard lock(lock_);
         return size_; 
     }
     
+    [[nodiscard]] size_t capacity() const noexcept {
+        read_guard lock(lock_);
+        return capacity_;
+    }
+    
     // 检查是否为空
     [[nodiscard]] bool empty() const noexcept { 
         return size() == 0; 
     }
     
-    // 迭代器支持
-    class iterator {
+    // 连续迭代器，可直接用于 std::execution 并行算法
+    template<bool Const>
+    class basic_iterator {
+    public:
+        using iterator_concept = std::contiguous_iterator_tag;
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const T*, T*>;
+        using reference = std::conditional_t<Const, const T&, T&>;
+        
+        basic_iterator() = default;
+        explicit basic_iterator(pointer ptr) noexcept : ptr_(ptr) {}
+        
+        // iterator 可隐式转换为 const_iterator
+        operator basic_iterator<true>() const noexcept requires (!Const) { return basic_iterator<true>(ptr_); }
+        
+        reference operator*() const noexcept { return *ptr_; }
+        pointer operator->() const noexcept { return ptr_; }
+        reference operator[](difference_type n) const noexcept { return ptr_[n]; }
+        
+        basic_iterator& operator++() noexcept { ++ptr_; return *this; }
+        basic_iterator operator++(int) noexcept { basic_iterator tmp = *this; ++ptr_; return tmp; }
+        basic_iterator& operator--() noexcept { --ptr_; return *this; }
+        basic_iterator operator--(int) noexcept { basic_iterator tmp = *this; --ptr_; return tmp; }
+        basic_iterator& operator+=(difference_type n) noexcept { ptr_ += n; return *this; }
+        basic_iterator& operator-=(difference_type n) noexcept { ptr_ -= n; return *this; }
+        
+        friend basic_iterator operator+(basic_iterator it, difference_type n) noexcept { return it += n; }
+        friend basic_iterator operator+(difference_type n, basic_iterator it) noexcept { return it += n; }
+        friend basic_iterator operator-(basic_iterator it, difference_type n) noexcept { return it -= n; }
+        friend difference_type operator-(basic_iterator a, basic_iterator b) noexcept { return a.ptr_ - b.ptr_; }
+        
+        bool operator==(const basic_iterator&) const = default;
+        auto operator<=>(const basic_iterator&) const = default;
+        
+    private:
+        pointer ptr_ = nullptr;
+    };
+    
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+    
+    // 一致性快照：持有读锁，存活期间写操作被阻塞，元素与大小保持不变
+    // 同一线程在快照存活时修改数组会死锁
+    class const_view {
     private:
-        T* ptr_;
+        std::shared_lock<Lock> lock_;
+        const T* data_;
+        size_t size_;
+        
     public:
-        explicit iterator(T* ptr) : ptr_(ptr) {}
-        
-        T& operator*() { return *ptr_; }
-        T* operator->() { return ptr_; }
-        iterator& operator++() { ++ptr_; return *this; }
-        iterator operator++(int) { iterator tmp = *this; ++ptr_; return tmp; }
-        bool operator==(const iterator& other) const { return ptr_ == other.ptr_; }
-        bool operator!=(const iterator& other) const { return ptr_ != other.ptr_; }
+        explicit const_view(const SmartArray& array)
+            : lock_(array.lock_), data_(array.data_), size_(array.size_) {}
+        
+        const_iterator begin() const noexcept { return const_iterator(data_); }
+        const_iterator end() const noexcept { return const_iterator(data_ + size_); }
+        [[nodiscard]] size_t size() const noexcept { return size_; }
+        [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+        const T& operator[](size_t index) const noexcept { return data_[index]; }
+        std::span<const T> span() const noexcept { return {data_, size_}; }
     };
     
-    iterator begin() { return iterator(data_.get()); }
-    iterator end() { return iterator(data_.get() + size_); }
+    [[nodiscard]] const_view snapshot() const { return const_view(*this); }
+    
+    // 迭代器与视图在下一次修改前有效；与写线程并发遍历请使用 snapshot()
+    iterator begin() { read_guard lock(lock_); return iterator(data_); }
+    iterator end() { read_guard lock(lock_); return iterator(data_ + size_); }
+    const_iterator begin() const { read_guard lock(lock_); return const_iterator(data_); }
+    const_iterator end() const { read_guard lock(lock_); return const_iterator(data_ + size_); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+    
+    std::span<T> span() { read_guard lock(lock_); return {data_, size_}; }
+    std::span<const T> span() const { read_guard lock(lock_); return {data_, size_}; }
     
 private:
-    void resize(size_t new_capacity) {
-        auto new_data = std::make_unique<T[]>(new_capacity);
-        for (size_t i = 0; i < size_; ++i) {
-            new_data[i] = std::move(data_[i]);
+    template<typename... Args>
+    void emplace_unlocked(Args&&... args) {
+        if (size_ < capacity_) {
+            ::new (static_cast<void*>(data_ + size_)) T(std::forward<Args>(args)...);
+        } else if constexpr (is_trivially_relocatable_v<T>) {
+            // 参数可能引用数组内的元素，先构造再扩容
+            T item(std::forward<Args>(args)...);
+            grow(size_ + 1);
+            ::new (static_cast<void*>(data_ + size_)) T(std::move(item));
+        } else {
+            grow(size_ + 1, std::forward<Args>(args)...);
+        }
+        ++size_;
+    }
+
+    bool is_inline() noexcept { return N > 0 && data_ == inline_.get(); }
+
+    // 从 other 取走全部元素，要求本对象为空且位于对象内存储上；other 随后回到空的对象内存储
+    void take(SmartArray& other) {
+        if (!other.is_inline()) {
+            data_ = std::exchange(other.data_, other.inline_.get());
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, N);
+            return;
+        }
+        if constexpr (N > 0) {
+            if constexpr (is_trivially_relocatable_v<T>) {
+                std::memcpy(static_cast<void*>(data_), static_cast<const void*>(other.data_), other.size_ * sizeof(T));
+            } else {
+                // 移动中途抛出时已构造的元素由 uninitialized_move_n 销毁，other 保持完整
+                std::uninitialized_move_n(other.data_, other.size_, data_);
+                std::destroy_n(other.data_, other.size_);
+            }
+            size_ = std::exchange(other.size_, 0);
+        }
+    }
+
+    static size_t bytes_for(size_t count) {
+        if (count > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::length_error("SmartArray capacity overflow");
+        }
+        return count * sizeof(T);
+    }
+
+    // 元素类型为 T 的连续范围：可以 memcpy，也可能指向本数组自身
+    template<typename R>
+    static constexpr bool contiguous_range_of_t =
+        std::ranges::contiguous_range<R> && std::same_as<std::remove_cv_t<std::ranges::range_value_t<R>>, T>;
+    
+    // range 是否指向本数组的元素（扩容或销毁后会失效）
+    template<typename R>
+    bool overlaps(R& range) const noexcept {
+        const T* p = std::ranges::data(range);
+        return std::less_equal<const T*>()(data_, p) && std::less<const T*>()(p, data_ + size_);
+    }
+    
+    template<typename R>
+    void append_unlocked(R&& range) {
+        if constexpr (contiguous_range_of_t<R>) {
+            if (overlaps(range)) {
+                std::vector<T> copy(std::ranges::begin(range), std::ranges::end(range));
+                append_unlocked(copy);
+                return;
+            }
+        }
+        if constexpr (std::ranges::sized_range<R> || std::ranges::forward_range<R>) {
+            size_t count = static_cast<size_t>(std::ranges::distance(range));
+            if (count > capacity_ - size_) {
+                if (count > std::numeric_limits<size_t>::max() - size_) {
+                    throw std::length_error("SmartArray capacity overflow");
+                }
+                reallocate(Growth::next(capacity_, size_ + count));
+            }
+            if constexpr (contiguous_range_of_t<R> && std::is_trivially_copyable_v<T>) {
+                if (count > 0) {
+                    std::memcpy(static_cast<void*>(data_ + size_), std::ranges::data(range), count * sizeof(T));
+                }
+                size_ += count;
+            } else {
+                for (auto&& item : range) {
+                    ::new (static_cast<void*>(data_ + size_)) T(std::forward<decltype(item)>(item));
+                    ++size_;
+                }
+            }
+        } else {
+            for (auto&& item : range) {
+                emplace_unlocked(std::forward<decltype(item)>(item));
+            }
+        }
+    }
+    
+    void destroy_elements() noexcept {
+        std::destroy_n(data_, size_);
+        size_ = 0;
+    }
+    
+    template<typename... Args>
+    void grow(size_t required, Args&&... args) {
+        reallocate(Growth::next(capacity_, required), std::forward<Args>(args)...);
+    }
+    
+    // 换到 new_capacity 大小的存储；非平凡搬移的类型在新存储上先构造新元素（若有），再逐个移动旧元素
+    template<typename... Args>
+    void reallocate(size_t new_capacity, Args&&... args) {
+        size_t new_bytes = bytes_for(new_capacity);
+
+        if constexpr (is_trivially_relocatable_v<T>) {
+            if constexpr (ReallocatingAllocator<Alloc>) {
+                if (data_ && !is_inline()) {
+                    if (void* p = alloc_.reallocate(data_, bytes_for(capacity_), new_bytes, alignof(T))) {
+                        data_ = static_cast<T*>(p);
+                        capacity_ = new_capacity;
+                        return;
+                    }
+                }
+            }
+            T* new_data = static_cast<T*>(alloc_.allocate(new_bytes, alignof(T)));
+            if (size_ > 0) {
+                std::memcpy(static_cast<void*>(new_data), static_cast<const void*>(data_), size_ * sizeof(T));
+            }
+            replace_storage(new_data, new_capacity);
+        } else {
+            T* new_data = static_cast<T*>(alloc_.allocate(new_bytes, alignof(T)));
+            size_t moved = 0;
+            try {
+                if constexpr (sizeof...(Args) > 0) {
+                    ::new (static_cast<void*>(new_data + size_)) T(std::forward<Args>(args)...);
+                }
+                for (; moved < size_; ++moved) {
+                    ::new (static_cast<void*>(new_data + moved)) T(std::move_if_noexcept(data_[moved]));
+                }
+            } catch (...) {
+                std::destroy_n(new_data, moved);
+                if constexpr (sizeof...(Args) > 0) {
+                    std::destroy_at(new_data + size_);
+                }
+                alloc_.deallocate(new_data, new_bytes, alignof(T));
+                throw;
+            }
+            std::destroy_n(data_, size_);
+            replace_storage(new_data, new_capacity);
         }
-        data_ = std::move(new_data);
+    }
+
+    void replace_storage(T* new_data, size_t new_capacity) noexcept {
+        if (data_ && !is_inline()) {
+            alloc_.deallocate(data_, capacity_ * sizeof(T), alignof(T));
+        }
+        data_ = new_data;
         capacity_ = new_capacity;
     }
+
+    void release() noexcept {
+        std::destroy_n(data_, size_);
+        if (data_ && !is_inline()) {
+            alloc_.deallocate(data_, capacity_ * sizeof(T), alignof(T));
+        }
+        data_ = inline_.get();
+        size_ = 0;
+        capacity_ = N;
+    }
+};
+
+static_assert(std::contiguous_iterator<SmartArray<int>::iterator>);
+static_assert(std::contiguous_iterator<SmartArray<int>::const_iterator>);
+
+// 无锁分段只追加数组：多个生产者并发追加，读者无需加锁
+// 段容量按 2 的幂递增，追加从不搬移已有元素，元素的引用与地址始终有效
+template<typename T>
+class ConcurrentSegmentedArray {
+private:
+    static constexpr size_t kFirstSegmentBits = 5;                 // 第一段 32 个元素
+    static constexpr size_t kFirstSegmentSize = size_t{1} << kFirstSegmentBits;
+    static constexpr size_t kMaxSegments = 48;
+
+    enum : uint8_t { kPending = 0, kConstructed = 1, kAbandoned = 2 };
+
+    struct Slot {
+        std::atomic<uint8_t> state{kPending};
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* get() noexcept { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    std::atomic<Slot*> segments_[kMaxSegments] = {};
+    std::atomic<size_t> reserved_{0};    // 已分配出去的下标数
+    std::atomic<size_t> published_{0};   // [0, published_) 均已构造完成（或构造失败）
+
+    // 下标 -> (段号, 段内偏移)：第 k 段覆盖 [32 * (2^k - 1), 32 * (2^(k+1) - 1))
+    static size_t segment_of(size_t index) noexcept {
+        return static_cast<size_t>(std::bit_width((index >> kFirstSegmentBits) + 1)) - 1;
+    }
+    static size_t segment_start(size_t segment) noexcept {
+        return kFirstSegmentSize * ((size_t{1} << segment) - 1);
+    }
+
+    // 定位槽位，所在段尚未分配时由调用者分配；并发分配时只有一个 CAS 成功，其余释放自己的段
+    Slot& slot_for_append(size_t index) {
+        size_t segment = segment_of(index);
+        if (segment >= kMaxSegments) {
+            throw std::length_error("ConcurrentSegmentedArray capacity exceeded");
+        }
+        Slot* base = segments_[segment].load(std::memory_order_acquire);
+        if (!base) {
+            Slot* fresh = new Slot[kFirstSegmentSize << segment];
+            if (segments_[segment].compare_exchange_strong(base, fresh, std::memory_order_acq_rel)) {
+                base = fresh;
+            } else {
+                delete[] fresh;
+            }
+        }
+        return base[index - segment_start(segment)];
+    }
+
+    Slot* slot_if_allocated(size_t index) const noexcept {
+        size_t segment = segment_of(index);
+        Slot* base = segment < kMaxSegments ? segments_[segment].load(std::memory_order_acquire) : nullptr;
+        return base ? &base[index - segment_start(segment)] : nullptr;
+    }
+
+    // 把已完成的连续前缀发布给读者；任何完成构造的生产者都会顺带推进，无需等待前面的生产者
+    void advance_published() noexcept {
+        size_t next = published_.load();
+        while (next < reserved_.load()) {
+            Slot* slot = slot_if_allocated(next);
+            if (!slot || slot->state.load() == kPending) {
+                break;
+            }
+            published_.compare_exchange_weak(next, next + 1);   // 失败时 next 更新为最新值
+        }
+    }
+
+    template<typename... Args>
+    size_t append(Args&&... args) {
+        size_t index = reserved_.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slot_for_append(index);
+        try {
+            ::new (static_cast<void*>(slot.storage)) T(std::forward<Args>(args)...);
+        } catch (...) {
+            // 构造失败的槽位不阻塞后续元素的发布，访问它时抛出异常
+            slot.state.store(kAbandoned);
+            advance_published();
+            throw;
+        }
+        slot.state.store(kConstructed);
+        advance_published();
+        return index;
+    }
+
+    T& element(size_t index) const {
+        Slot* slot = slot_if_allocated(index);
+        if (index >= published_.load(std::memory_order_acquire) || !slot ||
+            slot->state.load(std::memory_order_acquire) != kConstructed) {
+            throw std::out_of_range("Index out of range");
+        }
+        return *slot->get();
+    }
+
+public:
+    ConcurrentSegmentedArray() = default;
+
+    // 析构时不能再有并发的追加
+    ~ConcurrentSegmentedArray() {
+        size_t count = reserved_.load();
+        for (size_t segment = 0; segment < kMaxSegments; ++segment) {
+            Slot* base = segments_[segment].load();
+            if (!base) {
+                continue;
+            }
+            size_t start = segment_start(segment);
+            for (size_t i = 0; i < (kFirstSegmentSize << segment) && start + i < count; ++i) {
+                if (base[i].state.load() == kConstructed) {
+                    base[i].get()->~T();
+                }
+            }
+            delete[] base;
+        }
+    }
+
+    // 原子变量与稳定地址都不允许拷贝或移动
+    ConcurrentSegmentedArray(const ConcurrentSegmentedArray&) = delete;
+    ConcurrentSegmentedArray& operator=(const ConcurrentSegmentedArray&) = delete;
+
+    // 添加元素，返回其下标
+    size_t push_back(const T& item) { return append(item); }
+    size_t push_back(T&& item) { return append(std::move(item)); }
+
+    // 原地构造，返回的引用在数组生命周期内有效
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        size_t index = append(std::forward<Args>(args)...);
+        return *slot_if_allocated(index)->get();
+    }
+
+    // 访问元素：只能访问已发布的下标
+    T& operator[](size_t index) { return element(index); }
+    const T& operator[](size_t index) const { return element(index); }
+
+    // 已发布（读者可见）的元素个数
+    [[nodiscard]] size_t size() const noexcept { return published_.load(std::memory_order_acquire); }
+
+    [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+    // 遍历调用时已发布的元素，跳过构造失败的槽位；遍历期间可以继续追加
+    template<typename Func>
+    void for_each(Func&& func) const {
+        size_t count = size();
+        for (size_t i = 0; i < count; ++i) {
+            Slot* slot = slot_if_allocated(i);
+            if (slot->state.load(std::memory_order_acquire) == kConstructed) {
+                func(*slot->get());
+            }
+        }
+    }
 };
 
 // 概念 (C++20)
@@ -186,8 +900,8 @@ T sum(T&& t, Args&&... args) {
 template<typename T>
 struct is_smart_array : std::false_type {};
 
-template<typename T>
-struct is_smart_array<SmartArray<T>> : std::true_type {};
+template<typename T, size_t N, typename Alloc, typename Growth, typename Lock>
+struct is_smart_array<SmartArray<T, N, Alloc, Growth, Lock>> : std::true_type {};
 
 template<typename T>
 inline constexpr bool is_smart_array_v = is_smart_array<T>::value;
@@ -224,32 +938,316 @@ public:
     }
 };
 
-// 类型别名
-using UserId = StrongType<uint64_t, struct UserIdTag>;
-using UserName = StrongType<std::string, struct UserNameTag>;
+} // namespace LitheServer
 
-// 用户类
-class User {
+// 强类型的哈希与其底层类型一致，可直接作为无序容器的键
+template<typename T, typename Tag>
+struct std::hash<LitheServer::StrongType<T, Tag>> {
+    size_t operator()(const LitheServer::StrongType<T, Tag>& value) const
+        noexcept(noexcept(std::hash<T>{}(value.get()))) {
+        return std::hash<T>{}(value.get());
+    }
+};
+
+namespace LitheServer {
+
+// 开放寻址的扁平哈希索引（Swiss table 风格）：键映射到下标
+// 每个槽位有一个控制字节：空、已删除，或哈希值的低 7 位（H2）；
+// 探测以 16 个控制字节为一组，用 SSE2 一次比较整组，组内没有匹配且有空位即可确定不存在
+template<typename Key, typename Hash = std::hash<Key>>
+class FlatHashIndex {
 private:
-    UserId id_;
-    UserName name_;
-    std::string email_;
-    bool is_active_;
-    std::chrono::system_clock::time_point created_at_;
-    
-public:
-    User(UserId id, UserName name, std::string email)
-        : id_(std::move(id))
-        , name_(std::move(name))
-        , email_(std::move(email))
-        , is_active_(true)
-        , created_at_(std::chrono::system_clock::now()) {}
+    static constexpr size_t kGroupWidth = 16;
+    static constexpr int8_t kEmpty = -128;
+    static constexpr int8_t kDeleted = -2;
+
+    struct Slot {
+        Key key;
+        size_t value;
+    };
+
+    // 组内匹配位图，第 i 位对应组内第 i 个槽位
+    class BitMask {
+    private:
+        uint32_t bits_;
+    public:
+        explicit BitMask(uint32_t bits) noexcept : bits_(bits) {}
+        explicit operator bool() const noexcept { return bits_ != 0; }
+        size_t lowest() const noexcept { return static_cast<size_t>(std::countr_zero(bits_)); }
+        void clear_lowest() noexcept { bits_ &= bits_ - 1; }
+    };
+
+    static BitMask match(const int8_t* group, int8_t value) noexcept {
+#ifdef __SSE2__
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value)))));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < kGroupWidth; ++i) {
+            bits |= static_cast<uint32_t>(group[i] == value) << i;
+        }
+        return BitMask(bits);
+#endif
+    }
+
+    // 空或已删除（最高位为 1 且不是满槽）
+    static BitMask match_empty_or_deleted(const int8_t* group) noexcept {
+#ifdef __SSE2__
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(ctrl)));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < kGroupWidth; ++i) {
+            bits |= static_cast<uint32_t>(group[i] < 0) << i;
+        }
+        return BitMask(bits);
+#endif
+    }
+
+    std::unique_ptr<int8_t[]> ctrl_;
+    Slot* slots_ = nullptr;
+    size_t capacity_ = 0;      // 槽位数，0 或 kGroupWidth 的 2 的幂倍
+    size_t size_ = 0;
+    size_t growth_left_ = 0;   // 还能占用多少空槽（已删除的槽位不计入），保持负载不超过 7/8
+    [[no_unique_address]] Hash hash_;
+
+    // 标准库对整数的哈希是恒等映射，乘法混合后高位给 H1、低 7 位给 H2
+    size_t mixed_hash(const Key& key) const {
+        uint64_t h = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+    static size_t h1(size_t hash) noexcept { return hash >> 7; }
+    static int8_t h2(size_t hash) noexcept { return static_cast<int8_t>(hash & 0x7f); }
+
+    size_t group_count() const noexcept { return capacity_ / kGroupWidth; }
+
+    // 按三角数序列遍历各组，组数为 2 的幂时覆盖全部组
+    template<typename Visit>
+    auto probe(size_t hash, Visit&& visit) const {
+        size_t mask = group_count() - 1;
+        size_t group = h1(hash) & mask;
+        for (size_t step = 1;; ++step) {
+            if (auto result = visit(group * kGroupWidth)) {
+                return result;
+            }
+            group = (group + step) & mask;
+        }
+    }
+
+    // 返回键所在槽位，不存在时返回 capacity_
+    size_t find_slot(const Key& key) const {
+        if (size_ == 0) {
+            return capacity_;
+        }
+        size_t hash = mixed_hash(key);
+        return *probe(hash, [&](size_t base) -> std::optional<size_t> {
+            const int8_t* group = &ctrl_[base];
+            for (BitMask m = match(group, h2(hash)); m; m.clear_lowest()) {
+                size_t index = base + m.lowest();
+                if (slots_[index].key == key) {
+                    return index;
+                }
+            }
+            if (match(group, kEmpty)) {
+                return capacity_;
+            }
+            return std::nullopt;
+        });
+    }
+
+    // 新键的落脚点：探测序列上第一个空或已删除的槽位
+    size_t find_insert_slot(size_t hash) const {
+        return *probe(hash, [&](size_t base) -> std::optional<size_t> {
+            if (BitMask m = match_empty_or_deleted(&ctrl_[base])) {
+                return base + m.lowest();
+            }
+            return std::nullopt;
+        });
+    }
+
+    void rehash(size_t new_capacity) {
+        auto old_ctrl = std::move(ctrl_);
+        Slot* old_slots = slots_;
+        size_t old_capacity = capacity_;
+
+        ctrl_ = std::make_unique<int8_t[]>(new_capacity);
+        std::fill_n(ctrl_.get(), new_capacity, kEmpty);
+        slots_ = std::allocator<Slot>().allocate(new_capacity);
+        capacity_ = new_capacity;
+        growth_left_ = new_capacity - new_capacity / 8 - size_;
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old_ctrl[i] >= 0) {
+                size_t hash = mixed_hash(old_slots[i].key);
+                size_t index = find_insert_slot(hash);
+                ctrl_[index] = h2(hash);
+                ::new (static_cast<void*>(&slots_[index])) Slot(std::move(old_slots[i]));
+                std::destroy_at(&old_slots[i]);
+            }
+        }
+        if (old_slots) {
+            std::allocator<Slot>().deallocate(old_slots, old_capacity);
+        }
+    }
+
+    // 为一次插入腾出空间：已删除的槽位很多时原地重建，否则扩容一倍
+    void prepare_insert() {
+        if (growth_left_ > 0) {
+            return;
+        }
+        if (capacity_ == 0) {
+            rehash(kGroupWidth);
+        } else if (size_ * 2 <= capacity_ - capacity_ / 8) {
+            rehash(capacity_);
+        } else {
+            rehash(capacity_ * 2);
+        }
+    }
+
+public:
+    FlatHashIndex() = default;
+
+    ~FlatHashIndex() {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0) {
+                std::destroy_at(&slots_[i]);
+            }
+        }
+        if (slots_) {
+            std::allocator<Slot>().deallocate(slots_, capacity_);
+        }
+    }
+
+    // 复制控制字节与全部键，结构与原表完全相同，无需重新哈希
+    FlatHashIndex(const FlatHashIndex& other)
+        : size_(other.size_)
+        , growth_left_(other.growth_left_)
+        , hash_(other.hash_) {
+        if (other.capacity_ == 0) {
+            return;
+        }
+        ctrl_ = std::make_unique<int8_t[]>(other.capacity_);
+        std::copy_n(other.ctrl_.get(), other.capacity_, ctrl_.get());
+        slots_ = std::allocator<Slot>().allocate(other.capacity_);
+        capacity_ = other.capacity_;
+        size_t copied = 0;
+        try {
+            for (; copied < capacity_; ++copied) {
+                if (ctrl_[copied] >= 0) {
+                    ::new (static_cast<void*>(&slots_[copied])) Slot(other.slots_[copied]);
+                }
+            }
+        } catch (...) {
+            for (size_t i = 0; i < copied; ++i) {
+                if (ctrl_[i] >= 0) {
+                    std::destroy_at(&slots_[i]);
+                }
+            }
+            std::allocator<Slot>().deallocate(slots_, capacity_);
+            throw;
+        }
+    }
+
+    FlatHashIndex& operator=(const FlatHashIndex&) = delete;
+
+    // 预留空间，插入 count 个键前不再重建
+    void reserve(size_t count) {
+        size_t needed = kGroupWidth;
+        while (needed - needed / 8 < count) {
+            needed *= 2;
+        }
+        if (needed > capacity_) {
+            rehash(needed);
+        }
+    }
+
+    // 查找键对应的下标
+    [[nodiscard]] std::optional<size_t> find(const Key& key) const {
+        size_t index = find_slot(key);
+        if (index == capacity_) {
+            return std::nullopt;
+        }
+        return slots_[index].value;
+    }
+
+    [[nodiscard]] bool contains(const Key& key) const { return find_slot(key) != capacity_; }
+
+    // 插入新键，键已存在时不修改并返回 false
+    bool insert(const Key& key, size_t value) {
+        if (find_slot(key) != capacity_) {
+            return false;
+        }
+        prepare_insert();
+        size_t hash = mixed_hash(key);
+        size_t index = find_insert_slot(hash);
+        ::new (static_cast<void*>(&slots_[index])) Slot{key, value};
+        if (ctrl_[index] == kEmpty) {
+            --growth_left_;
+        }
+        ctrl_[index] = h2(hash);
+        ++size_;
+        return true;
+    }
+
+    // 修改已有键的下标，键不存在时返回 false
+    bool assign(const Key& key, size_t value) {
+        size_t index = find_slot(key);
+        if (index == capacity_) {
+            return false;
+        }
+        slots_[index].value = value;
+        return true;
+    }
+
+    // 删除键；所在组仍有空位时没有探测会越过这一组，可以直接标为空而不留墓碑
+    bool erase(const Key& key) {
+        size_t index = find_slot(key);
+        if (index == capacity_) {
+            return false;
+        }
+        std::destroy_at(&slots_[index]);
+        size_t base = index / kGroupWidth * kGroupWidth;
+        if (match(&ctrl_[base], kEmpty)) {
+            ctrl_[index] = kEmpty;
+            ++growth_left_;
+        } else {
+            ctrl_[index] = kDeleted;
+        }
+        --size_;
+        return true;
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+};
+
+// 类型别名
+using UserId = StrongType<uint64_t, struct UserIdTag>;
+using UserName = StrongType<std::string, struct UserNameTag>;
+
+// 用户类
+class User {
+private:
+    UserId id_;
+    UserName name_;
+    std::string email_;
+    bool is_active_;
+    std::chrono::system_clock::time_point created_at_;
+    
+public:
+    User(UserId id, UserName name, std::string email)
+        : id_(std::move(id))
+        , name_(std::move(name))
+        , email_(std::move(email))
+        , is_active_(true)
+        , created_at_(std::chrono::system_clock::now()) {}
     
     // Getter 方法
     [[nodiscard]] const UserId& id() const noexcept { return id_; }
     [[nodiscard]] const UserName& name() const noexcept { return name_; }
     [[nodiscard]] const std::string& email() const noexcept { return email_; }
     [[nodiscard]] bool is_active() const noexcept { return is_active_; }
+    [[nodiscard]] std::chrono::system_clock::time_point created_at() const noexcept { return created_at_; }
     
     // Setter 方法
     void set_active(bool active) noexcept { is_active_ = active; }
@@ -262,13 +1260,214 @@ public:
     }
 };
 
+// 列式用户存储：每个字段一列，扫描只读取用到的列
+// id 与创建时间（Unix 微秒）为定长数组，激活状态为位图，名字与邮箱存放在共享字符串堆中按偏移引用
+class ColumnarUserStore {
+private:
+    struct StringRef {
+        uint64_t offset;
+        uint32_t length;
+    };
+
+    std::vector<uint64_t> ids_;
+    std::vector<int64_t> created_at_us_;
+    std::vector<uint64_t> active_;      // 第 i 行对应第 i / 64 个字的第 i % 64 位
+    std::vector<StringRef> names_;
+    std::vector<StringRef> emails_;
+    std::string strings_;
+
+    static int64_t to_micros(std::chrono::system_clock::time_point tp) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(tp.time_since_epoch()).count();
+    }
+
+    StringRef intern(std::string_view text) {
+        if (text.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::length_error("ColumnarUserStore string too long");
+        }
+        StringRef ref{strings_.size(), static_cast<uint32_t>(text.size())};
+        strings_.append(text);
+        return ref;
+    }
+
+    std::string_view view(StringRef ref) const noexcept {
+        return std::string_view(strings_).substr(ref.offset, ref.length);
+    }
+
+    // 过滤内核：计算 [0, count) 行中 created_at <= cutoff 的位图，每 64 行写一个字
+    using OlderMaskKernel = void (*)(const int64_t* created, size_t count, int64_t cutoff, uint64_t* masks);
+
+    static void older_masks_scalar(const int64_t* created, size_t count, int64_t cutoff, uint64_t* masks) {
+        for (size_t w = 0; w * 64 < count; ++w) {
+            size_t rows = std::min<size_t>(64, count - w * 64);
+            uint64_t mask = 0;
+            for (size_t i = 0; i < rows; ++i) {
+                mask |= static_cast<uint64_t>(created[w * 64 + i] <= cutoff) << i;
+            }
+            masks[w] = mask;
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // 每次比较 4 个 int64，movemask 取出比较结果的符号位
+    __attribute__((target("avx2")))
+    static void older_masks_avx2(const int64_t* created, size_t count, int64_t cutoff, uint64_t* masks) {
+        const __m256i limit = _mm256_set1_epi64x(cutoff);
+        size_t full = count / 64;
+        for (size_t w = 0; w < full; ++w) {
+            const int64_t* block = created + w * 64;
+            uint64_t mask = 0;
+            for (size_t j = 0; j < 64; j += 4) {
+                __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + j));
+                // 大于 cutoff 的行不满足条件
+                auto newer = static_cast<uint64_t>(
+                    _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(values, limit))));
+                mask |= (~newer & 0xF) << j;
+            }
+            masks[w] = mask;
+        }
+        if (count % 64 != 0) {
+            older_masks_scalar(created + full * 64, count % 64, cutoff, masks + full);
+        }
+    }
+#endif
+
+    // 运行时按 CPU 能力选择一次内核
+    static OlderMaskKernel older_mask_kernel() {
+        static const OlderMaskKernel kernel = []() -> OlderMaskKernel {
+#if defined(__x86_64__) || defined(__i386__)
+            if (__builtin_cpu_supports("avx2")) {
+                return &older_masks_avx2;
+            }
+#endif
+            return &older_masks_scalar;
+        }();
+        return kernel;
+    }
+
+    // 按 4096 行一块计算满足条件的位图，与激活位图相与后交给 func(字下标, 位图)
+    template<typename Func>
+    void for_each_active_older_block(std::chrono::days age, std::chrono::system_clock::time_point now,
+                                     Func&& func) const {
+        constexpr size_t kBlockWords = 64;
+        int64_t cutoff = to_micros(now - age);
+        OlderMaskKernel kernel = older_mask_kernel();
+        uint64_t masks[kBlockWords];
+        for (size_t first = 0; first < ids_.size(); first += kBlockWords * 64) {
+            size_t rows = std::min(kBlockWords * 64, ids_.size() - first);
+            kernel(created_at_us_.data() + first, rows, cutoff, masks);
+            size_t first_word = first / 64;
+            for (size_t w = 0; w < (rows + 63) / 64; ++w) {
+                func(first_word + w, masks[w] & active_[first_word + w]);
+            }
+        }
+    }
+
+public:
+    // 单行的只读视图，字符串指向内部的字符串堆，追加新行后失效
+    struct Row {
+        UserId id;
+        std::string_view name;
+        std::string_view email;
+        bool active;
+        std::chrono::system_clock::time_point created_at;
+    };
+
+    void reserve(size_t rows) {
+        ids_.reserve(rows);
+        created_at_us_.reserve(rows);
+        active_.reserve((rows + 63) / 64);
+        names_.reserve(rows);
+        emails_.reserve(rows);
+    }
+
+    // 添加一行，返回行号
+    size_t append(const UserId& id, std::string_view name, std::string_view email, bool active,
+                  std::chrono::system_clock::time_point created_at) {
+        size_t row = ids_.size();
+        if (row % 64 == 0) {
+            active_.push_back(0);
+        }
+        ids_.push_back(id.get());
+        created_at_us_.push_back(to_micros(created_at));
+        names_.push_back(intern(name));
+        emails_.push_back(intern(email));
+        set_active(row, active);
+        return row;
+    }
+
+    size_t append(const User& user) {
+        return append(user.id(), user.name().get(), user.email(), user.is_active(), user.created_at());
+    }
+
+    void set_active(size_t row, bool active) noexcept {
+        uint64_t bit = uint64_t{1} << (row % 64);
+        active_[row / 64] = active ? (active_[row / 64] | bit) : (active_[row / 64] & ~bit);
+    }
+
+    [[nodiscard]] Row row(size_t index) const {
+        if (index >= ids_.size()) {
+            throw std::out_of_range("Index out of range");
+        }
+        return Row{
+            UserId(ids_[index]),
+            view(names_[index]),
+            view(emails_[index]),
+            ((active_[index / 64] >> (index % 64)) & 1) != 0,
+            std::chrono::system_clock::time_point(std::chrono::microseconds(created_at_us_[index])),
+        };
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return ids_.size(); }
+
+    // 激活用户数：只读位图
+    [[nodiscard]] size_t count_active() const noexcept {
+        size_t count = 0;
+        for (uint64_t word : active_) {
+            count += static_cast<size_t>(std::popcount(word));
+        }
+        return count;
+    }
+
+    // 注册超过 age 的激活用户数：只读创建时间列与激活位图
+    [[nodiscard]] size_t count_active_older_than(std::chrono::days age,
+            std::chrono::system_clock::time_point now = std::chrono::system_clock::now()) const {
+        size_t count = 0;
+        for_each_active_older_block(age, now, [&count](size_t, uint64_t mask) {
+            count += static_cast<size_t>(std::popcount(mask));
+        });
+        return count;
+    }
+
+    // 注册超过 age 的激活用户的行号
+    [[nodiscard]] std::vector<size_t> select_active_older_than(std::chrono::days age,
+            std::chrono::system_clock::time_point now = std::chrono::system_clock::now()) const {
+        std::vector<size_t> rows;
+        for_each_active_older_block(age, now, [&rows](size_t word, uint64_t mask) {
+            for (; mask != 0; mask &= mask - 1) {
+                rows.push_back(word * 64 + static_cast<size_t>(std::countr_zero(mask)));
+            }
+        });
+        return rows;
+    }
+
+    // 当前使用的过滤内核，便于确认运行时分派结果
+    [[nodiscard]] static const char* filter_kernel_name() {
+#if defined(__x86_64__) || defined(__i386__)
+        if (older_mask_kernel() == &older_masks_avx2) {
+            return "avx2";
+        }
+#endif
+        return "scalar";
+    }
+};
+
 // 访问者模式 (std::variant)
-using UserAction = std::variant<
-    struct Login { std::string ip_address; },
-    struct Logout { std::chrono::system_clock::time_point timestamp; },
-    struct UpdateProfile { std::string field; std::string new_value; },
-    struct DeleteAccount { std::string reason; }
->;
+struct Login { std::string ip_address; };
+struct Logout { std::chrono::system_clock::time_point timestamp; };
+struct UpdateProfile { std::string field; std::string new_value; };
+struct DeleteAccount { std::string reason; };
+
+using UserAction = std::variant<Login, Logout, UpdateProfile, DeleteAccount>;
 
 // 访问者函数
 struct UserActionVisitor {
@@ -292,53 +1491,907 @@ struct UserActionVisitor {
 };
 
 // 异步操作
-class AsyncUserService {
+// Chase-Lev 工作窃取双端队列：所有者在底部压入/弹出，其他线程从顶部窃取
+// 满时所有者扩容为两倍，旧数组可能仍被窃取者读取，保留到队列析构
+template<typename T>
+class ChaseLevDeque {
 private:
-    std::vector<User> users_;
-    mutable std::shared_mutex users_mutex_;
-    
+    static_assert(std::is_trivially_copyable_v<T>, "ChaseLevDeque stores trivially copyable values");
+
+    struct Buffer {
+        int64_t capacity;
+        std::unique_ptr<std::atomic<T>[]> slots;
+
+        explicit Buffer(int64_t cap) : capacity(cap), slots(new std::atomic<T>[cap]) {}
+
+        T get(int64_t i) const noexcept { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+        void put(int64_t i, T value) noexcept { slots[i & (capacity - 1)].store(value, std::memory_order_relaxed); }
+    };
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<Buffer*> buffer_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;   // 当前数组与所有退役数组，仅所有者修改
+
 public:
-    // 异步查找用户
-    std::future<std::optional<User>> find_user_async(const UserId& id) const {
-        return std::async(std::launch::async, [this, id]() -> std::optional<User> {
-            std::shared_lock<std::shared_mutex> lock(users_mutex_);
-            
-            auto it = std::find_if(users_.begin(), users_.end(),
-                [&id](const User& user) {
-                    return user.id().get() == id.get();
-                });
-            
-            if (it != users_.end()) {
-                return *it;
+    explicit ChaseLevDeque(int64_t capacity = 256) {
+        buffers_.push_back(std::make_unique<Buffer>(capacity));
+        buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+    }
+
+    ChaseLevDeque(const ChaseLevDeque&) = delete;
+    ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+    // 仅所有者调用
+    void push(T value) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+        if (b - t >= buffer->capacity - 1) {
+            auto grown = std::make_unique<Buffer>(buffer->capacity * 2);
+            for (int64_t i = t; i < b; ++i) {
+                grown->put(i, buffer->get(i));
             }
+            buffer = grown.get();
+            buffers_.push_back(std::move(grown));
+            buffer_.store(buffer, std::memory_order_release);
+        }
+        buffer->put(b, value);
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    // 仅所有者调用，后进先出
+    std::optional<T> pop() noexcept {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_seq_cst);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
             return std::nullopt;
-        });
+        }
+        T value = buffer->get(b);
+        if (t == b) {
+            // 只剩最后一个元素，与窃取者竞争
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            if (!won) {
+                return std::nullopt;
+            }
+        }
+        return value;
+    }
+
+    // 任意线程调用，先进先出；竞争失败时返回空，调用者换一个队列重试
+    std::optional<T> steal() noexcept {
+        int64_t t = top_.load(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_seq_cst);
+        if (t >= b) {
+            return std::nullopt;
+        }
+        T value = buffer_.load(std::memory_order_acquire)->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        return value;
+    }
+};
+
+// 线程池中的任务：run() 执行完毕后释放自身
+class ExecutorJob {
+public:
+    virtual ~ExecutorJob() = default;
+    virtual void run() noexcept = 0;
+};
+
+template<typename R>
+class Future;
+
+// 任务与 Future 共享的结果，与任务本身在同一次分配中；任务和 Future 各持有一个引用
+template<typename R>
+class FutureState {
+public:
+    virtual ~FutureState() = default;
+
+protected:
+    friend class Future<R>;
+
+    std::atomic<uint32_t> refs_{2};
+    std::atomic<bool> ready_{false};
+    std::conditional_t<std::is_void_v<R>, std::monostate, std::optional<R>> value_;
+    std::exception_ptr error_;
+
+    void release() noexcept {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
     }
+
+    void complete() noexcept {
+        ready_.store(true, std::memory_order_release);
+        ready_.notify_all();
+        release();
+    }
+};
+
+class WorkStealingExecutor;
+
+// 轻量级 Future：无额外的共享状态分配，get() 只能调用一次
+template<typename R>
+class Future {
+private:
+    FutureState<R>* state_;
+
+public:
+    explicit Future(FutureState<R>* state) noexcept : state_(state) {}
+    Future(Future&& other) noexcept : state_(std::exchange(other.state_, nullptr)) {}
+    Future& operator=(Future&& other) noexcept {
+        if (this != &other) {
+            if (state_) {
+                state_->release();
+            }
+            state_ = std::exchange(other.state_, nullptr);
+        }
+        return *this;
+    }
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+    ~Future() {
+        if (state_) {
+            state_->release();
+        }
+    }
+
+    [[nodiscard]] bool valid() const noexcept { return state_ != nullptr; }
+    [[nodiscard]] bool is_ready() const noexcept { return state_->ready_.load(std::memory_order_acquire); }
+
+    // 在工作线程上等待时顺便执行其他任务，避免所有工作线程互相等待
+    void wait() const;
+
+    R get() {
+        wait();
+        Future self(std::move(*this));   // 返回后释放共享状态
+        if (self.state_->error_) {
+            std::rethrow_exception(self.state_->error_);
+        }
+        if constexpr (!std::is_void_v<R>) {
+            return std::move(*self.state_->value_);
+        }
+    }
+};
+
+// 工作窃取线程池：每个工作线程有自己的 Chase-Lev 队列，外部线程提交的任务进入全局注入队列
+// 工作线程依次从本地队列、注入队列、其他线程的队列取任务，都没有时才休眠
+class WorkStealingExecutor {
+private:
+    struct Worker {
+        ChaseLevDeque<ExecutorJob*> deque;
+        std::thread thread;
+    };
+
+    template<typename F>
+    class CallbackJob final : public ExecutorJob {
+    public:
+        explicit CallbackJob(F func) : func_(std::move(func)) {}
+        // 回调抛出的异常无处可去，与 std::thread 一致地终止进程
+        void run() noexcept override {
+            func_();
+            delete this;
+        }
+    private:
+        F func_;
+    };
+
+    template<typename F, typename R>
+    class PromiseJob final : public ExecutorJob, public FutureState<R> {
+    public:
+        explicit PromiseJob(F func) : func_(std::move(func)) {}
+        void run() noexcept override {
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    func_();
+                } else {
+                    this->value_.emplace(func_());
+                }
+            } catch (...) {
+                this->error_ = std::current_exception();
+            }
+            this->complete();
+        }
+    private:
+        F func_;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex injection_mutex_;
+    std::deque<ExecutorJob*> injection_;
+    std::atomic<size_t> pending_{0};      // 已提交但尚未被取走的任务数
+    std::atomic<size_t> sleepers_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    std::atomic<bool> stopping_{false};
+
+    // 当前线程所属的线程池与工作线程下标
+    static inline thread_local WorkStealingExecutor* current_executor_ = nullptr;
+    static inline thread_local size_t current_index_ = 0;
+
+    void enqueue(ExecutorJob* job) {
+        pending_.fetch_add(1, std::memory_order_seq_cst);
+        if (current_executor_ == this) {
+            workers_[current_index_]->deque.push(job);
+        } else {
+            std::lock_guard<std::mutex> lock(injection_mutex_);
+            injection_.push_back(job);
+        }
+        // 与 worker_loop 中的 sleepers_ / pending_ 顺序配对，避免丢失唤醒
+        if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.notify_one();
+        }
+    }
+
+    ExecutorJob* find_job(size_t index, uint64_t& rng) {
+        if (auto job = workers_[index]->deque.pop()) {
+            return *job;
+        }
+        {
+            std::lock_guard<std::mutex> lock(injection_mutex_);
+            if (!injection_.empty()) {
+                ExecutorJob* job = injection_.front();
+                injection_.pop_front();
+                return job;
+            }
+        }
+        // 从随机位置开始轮询其他线程的队列
+        size_t count = workers_.size();
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        size_t start = static_cast<size_t>(rng % count);
+        for (size_t i = 0; i < count; ++i) {
+            size_t victim = (start + i) % count;
+            if (victim == index) {
+                continue;
+            }
+            if (auto job = workers_[victim]->deque.steal()) {
+                return *job;
+            }
+        }
+        return nullptr;
+    }
+
+    bool run_one(size_t index, uint64_t& rng) {
+        ExecutorJob* job = find_job(index, rng);
+        if (!job) {
+            return false;
+        }
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        job->run();
+        return true;
+    }
+
+    void worker_loop(size_t index) {
+        current_executor_ = this;
+        current_index_ = index;
+        uint64_t rng = 0x9E3779B97F4A7C15ull * (index + 1);
+
+        for (;;) {
+            if (run_one(index, rng)) {
+                continue;
+            }
+            if (pending_.load(std::memory_order_seq_cst) > 0) {
+                // 任务已计数但尚未入队，或窃取时竞争失败
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            sleep_cv_.wait(lock, [this] {
+                return stopping_.load() || pending_.load(std::memory_order_seq_cst) > 0;
+            });
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+            if (stopping_.load() && pending_.load() == 0) {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit WorkStealingExecutor(size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        // 全部队列建好后再启动线程，窃取时不会看到未构造的队列
+        for (size_t i = 0; i < threads; ++i) {
+            workers_[i]->thread = std::thread(&WorkStealingExecutor::worker_loop, this, i);
+        }
+    }
+
+    // 执行完所有已提交的任务后退出
+    ~WorkStealingExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_.store(true);
+        }
+        sleep_cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker->thread.join();
+        }
+    }
+
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    // 进程级默认线程池
+    static WorkStealingExecutor& global() {
+        static WorkStealingExecutor executor;
+        return executor;
+    }
+
+    // 提交回调，不关心结果
+    template<typename F>
+    void post(F&& func) {
+        enqueue(new CallbackJob<std::decay_t<F>>(std::forward<F>(func)));
+    }
+
+    // 提交任务，返回 Future
+    template<typename F>
+    auto submit(F&& func) -> Future<std::invoke_result_t<std::decay_t<F>&>> {
+        using R = std::invoke_result_t<std::decay_t<F>&>;
+        auto* job = new PromiseJob<std::decay_t<F>, R>(std::forward<F>(func));
+        enqueue(job);
+        return Future<R>(job);
+    }
+
+    [[nodiscard]] static bool on_worker_thread() noexcept { return current_executor_ != nullptr; }
+
+    // 当前线程若是某个线程池的工作线程，执行一个待处理任务；没有可执行的任务时返回 false
+    static bool help_one() {
+        WorkStealingExecutor* executor = current_executor_;
+        if (!executor) {
+            return false;
+        }
+        thread_local uint64_t rng = 0x2545F4914F6CDD1Dull;
+        return executor->run_one(current_index_, rng);
+    }
+
+    [[nodiscard]] size_t thread_count() const noexcept { return workers_.size(); }
+};
+
+template<typename R>
+void Future<R>::wait() const {
+    if (!WorkStealingExecutor::on_worker_thread()) {
+        state_->ready_.wait(false, std::memory_order_acquire);
+        return;
+    }
+    // 工作线程不能阻塞：等待的任务可能就在本线程的队列里
+    while (!is_ready()) {
+        if (!WorkStealingExecutor::help_one()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// 等待一组任务全部结束，返回第一个异常（没有则为空）
+// 任务常引用调用方栈上的数据，必须全部结束后调用方才能离开作用域或重新抛出
+inline std::exception_ptr wait_all(std::vector<Future<void>>& pending) noexcept {
+    std::exception_ptr first_error;
+    for (auto& future : pending) {
+        future.wait();
+    }
+    for (auto& future : pending) {
+        try {
+            future.get();
+        } catch (...) {
+            if (!first_error) {
+                first_error = std::current_exception();
+            }
+        }
+    }
+    return first_error;
+}
+
+// 基于纪元的内存回收（EBR）：读者进入临界区时只在自己独占的缓存行上公布当前纪元，
+// 不对共享数据做原子读改写；写者把旧对象交给 retire()，待所有读者都越过两个纪元后才释放
+class EpochDomain {
+private:
+    static constexpr uint64_t kIdle = std::numeric_limits<uint64_t>::max();
+
+    // 每个线程一条记录，线程退出后留给新线程复用，从不释放
+    struct alignas(64) Record {
+        std::atomic<uint64_t> epoch{kIdle};
+        std::atomic<bool> in_use{false};
+        unsigned depth = 0;          // 仅所属线程访问，支持嵌套 pin()
+        Record* next = nullptr;
+    };
+
+    struct Retired {
+        void* ptr;
+        void (*deleter)(void*);
+        uint64_t epoch;
+    };
+
+    alignas(64) std::atomic<uint64_t> epoch_{0};
+    std::atomic<Record*> records_{nullptr};
+    std::mutex retired_mutex_;       // 串行化 retire 与纪元推进，读者从不获取
+    std::vector<Retired> retired_;
+
+    EpochDomain() = default;
+
+    Record* acquire_record() {
+        for (Record* r = records_.load(std::memory_order_acquire); r; r = r->next) {
+            bool expected = false;
+            if (!r->in_use.load(std::memory_order_relaxed) &&
+                r->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return r;
+            }
+        }
+        auto* r = new Record();
+        r->in_use.store(true, std::memory_order_relaxed);
+        Record* head = records_.load(std::memory_order_relaxed);
+        do {
+            r->next = head;
+        } while (!records_.compare_exchange_weak(head, r, std::memory_order_release, std::memory_order_relaxed));
+        return r;
+    }
+
+    Record& local_record() {
+        struct Holder {
+            Record* record = nullptr;
+            ~Holder() {
+                if (record) {
+                    record->epoch.store(kIdle, std::memory_order_release);
+                    record->in_use.store(false, std::memory_order_release);
+                }
+            }
+        };
+        thread_local Holder holder;
+        if (!holder.record) {
+            holder.record = acquire_record();
+        }
+        return *holder.record;
+    }
+
+    // 所有处于临界区的读者都已进入当前纪元时推进一步；调用者持有 retired_mutex_
+    void try_advance() {
+        uint64_t current = epoch_.load(std::memory_order_relaxed);
+        for (Record* r = records_.load(std::memory_order_acquire); r; r = r->next) {
+            uint64_t e = r->epoch.load(std::memory_order_seq_cst);
+            if (e != kIdle && e != current) {
+                return;
+            }
+        }
+        epoch_.store(current + 1, std::memory_order_seq_cst);
+    }
+
+    // 取出可以释放的对象；调用者持有 retired_mutex_，在锁外执行析构
+    std::vector<Retired> collect() {
+        uint64_t current = epoch_.load(std::memory_order_relaxed);
+        auto ready = std::partition(retired_.begin(), retired_.end(),
+            [current](const Retired& item) { return item.epoch + 2 > current; });
+        std::vector<Retired> result(ready, retired_.end());
+        retired_.erase(ready, retired_.end());
+        return result;
+    }
+
+    static void destroy(const std::vector<Retired>& items) {
+        for (const Retired& item : items) {
+            item.deleter(item.ptr);
+        }
+    }
+
+public:
+    // 线程退出时的清理仍会访问记录，因此域本身故意不析构
+    static EpochDomain& global() {
+        static EpochDomain* domain = new EpochDomain();
+        return *domain;
+    }
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    // 读临界区：Guard 存活期间读到的对象不会被释放
+    class Guard {
+    private:
+        Record* record_;
+    public:
+        explicit Guard(Record* record) noexcept : record_(record) {}
+        Guard(Guard&& other) noexcept : record_(std::exchange(other.record_, nullptr)) {}
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+        ~Guard() {
+            if (record_ && --record_->depth == 0) {
+                record_->epoch.store(kIdle, std::memory_order_release);
+            }
+        }
+    };
+
+    [[nodiscard]] Guard pin() {
+        Record& r = local_record();
+        if (r.depth++ == 0) {
+            // 公布的纪元可能已经落后，只会更保守；seq_cst 存储保证随后读到的指针不早于这次公布
+            r.epoch.store(epoch_.load(std::memory_order_acquire), std::memory_order_seq_cst);
+        }
+        return Guard(&r);
+    }
+
+    // 交出一个已从共享结构中摘除的对象，宽限期过后用 delete 释放
+    template<typename T>
+    void retire(const T* ptr) {
+        retire(const_cast<T*>(ptr), [](void* p) { delete static_cast<T*>(p); });
+    }
+
+    void retire(void* ptr, void (*deleter)(void*)) {
+        std::vector<Retired> ready;
+        {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+            retired_.push_back({ptr, deleter, epoch_.load(std::memory_order_relaxed)});
+            try_advance();
+            ready = collect();
+        }
+        destroy(ready);
+    }
+
+    // 等待宽限期并释放全部待回收对象；不能在读临界区内调用，否则永远等不到自己离开
+    void synchronize() {
+        for (;;) {
+            std::vector<Retired> ready;
+            bool done;
+            {
+                std::lock_guard<std::mutex> lock(retired_mutex_);
+                try_advance();
+                ready = collect();
+                done = retired_.empty();
+            }
+            destroy(ready);
+            if (done) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+};
+
+class AsyncUserService {
+private:
+    // 合并后的用户表主体，只在合并时整体重建，多个版本共享同一份
+    struct Base {
+        std::vector<std::shared_ptr<const User>> users;
+        FlatHashIndex<UserId> index;   // UserId -> users 中的下标
+    };
     
-    // 异步添加用户
-    std::future<bool> add_user_async(User user) {
-        return std::async(std::launch::async, [this, user = std::move(user)]() -> bool {
-            std::unique_lock<std::shared_mutex> lock(users_mutex_);
-            
-            // 检查用户是否已存在
-            auto exists = std::any_of(users_.begin(), users_.end(),
-                [&user](const User& existing) {
-                    return existing.id().get() == user.id().get();
-                });
-            
-            if (!exists) {
-                users_.emplace_back(std::move(user));
+    // 不可变的用户表版本：发布后任何线程都不再修改；用户对象在相邻版本间共享
+    // 版本 = 共享的主体 + 小的增量层，单次写入只复制增量层；增量超过 merge_threshold()
+    // 才合并出新主体，阈值约为 √n，每次写入的摊还代价为 O(√n) 而不是 O(n)
+    struct Snapshot {
+        static constexpr size_t kRemoved = std::numeric_limits<size_t>::max();
+        static constexpr size_t kMinMergeThreshold = 64;
+        
+        std::shared_ptr<const Base> base = std::make_shared<const Base>();
+        std::vector<std::shared_ptr<const User>> added;  // 主体中不可见的新用户
+        FlatHashIndex<UserId> overlay;   // UserId -> added 中的下标，kRemoved 表示主体中的该用户已删除
+        
+        [[nodiscard]] const User* find(const UserId& id) const {
+            if (auto slot = overlay.find(id)) {
+                return *slot == kRemoved ? nullptr : added[*slot].get();
+            }
+            if (auto index = base->index.find(id)) {
+                return base->users[*index].get();
+            }
+            return nullptr;
+        }
+        
+        // 用户已可见时不修改并返回 false
+        bool insert(std::shared_ptr<const User> user) {
+            UserId id = user->id();
+            if (auto slot = overlay.find(id)) {
+                if (*slot != kRemoved) {
+                    return false;
+                }
+                overlay.assign(id, added.size());
+            } else if (base->index.contains(id)) {
+                return false;
+            } else {
+                overlay.insert(id, added.size());
+            }
+            added.push_back(std::move(user));
+            return true;
+        }
+        
+        // 增量层中的用户以末尾元素填补空位；主体中的用户只留下删除标记
+        bool erase(const UserId& id) {
+            if (auto slot = overlay.find(id)) {
+                if (*slot == kRemoved) {
+                    return false;
+                }
+                if (*slot != added.size() - 1) {
+                    added[*slot] = std::move(added.back());
+                    overlay.assign(added[*slot]->id(), *slot);
+                }
+                added.pop_back();
+                if (base->index.contains(id)) {
+                    overlay.assign(id, kRemoved);
+                } else {
+                    overlay.erase(id);
+                }
                 return true;
             }
+            if (!base->index.contains(id)) {
+                return false;
+            }
+            overlay.insert(id, kRemoved);
+            return true;
+        }
+        
+        [[nodiscard]] size_t merge_threshold() const noexcept {
+            return std::max(kMinMergeThreshold, size_t{1} << (std::bit_width(base->users.size()) / 2));
+        }
+        
+        // 主体中未被覆盖的用户加上增量层，重建为不带增量层的新版本
+        [[nodiscard]] std::unique_ptr<Snapshot> merged() const {
+            auto merged_base = std::make_shared<Base>();
+            merged_base->users.reserve(base->users.size() + added.size());
+            merged_base->index.reserve(base->users.size() + added.size());
+            auto append = [&](const std::shared_ptr<const User>& user) {
+                merged_base->index.insert(user->id(), merged_base->users.size());
+                merged_base->users.push_back(user);
+            };
+            for (const auto& user : base->users) {
+                if (overlay.empty() || !overlay.contains(user->id())) {
+                    append(user);
+                }
+            }
+            for (const auto& user : added) {
+                append(user);
+            }
+            auto next = std::make_unique<Snapshot>();
+            next->base = std::move(merged_base);
+            return next;
+        }
+        
+        template<typename Func>
+        void for_each(Func& func) const {
+            for (const auto& user : base->users) {
+                if (overlay.empty() || !overlay.contains(user->id())) {
+                    func(*user);
+                }
+            }
+            for (const auto& user : added) {
+                func(*user);
+            }
+        }
+    };
+    
+    // 按 UserId 哈希划分的分片，各自独立发布版本；头部独占缓存行，相邻分片的写者互不干扰
+    // 读者无锁读取当前版本；写者在分片的 writer_mutex 下复制、修改并发布新版本
+    struct alignas(64) Shard {
+        std::atomic<const Snapshot*> current{nullptr};
+        std::mutex writer_mutex;
+    };
+    
+    std::unique_ptr<Shard[]> shards_;
+    size_t shard_bits_;
+    WorkStealingExecutor& executor_;
+    
+    size_t shard_count() const noexcept { return size_t{1} << shard_bits_; }
+    
+    // 取乘法哈希的最高几位，与分片内索引使用的低位互不相关
+    Shard& shard_for(const UserId& id) const noexcept {
+        if (shard_bits_ == 0) {
+            return shards_[0];
+        }
+        uint64_t h = static_cast<uint64_t>(std::hash<UserId>{}(id)) * 0x9E3779B97F4A7C15ull;
+        return shards_[h >> (64 - shard_bits_)];
+    }
+    
+    static size_t default_shard_count() noexcept {
+        return std::bit_ceil(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    
+    // 读临界区覆盖所有分片，进入一次即可读取任意分片的当前版本
+    static const Snapshot& current_of(const Shard& shard) noexcept {
+        return *shard.current.load(std::memory_order_seq_cst);
+    }
+    
+    // 发布新版本，旧版本等到没有读者能看到它之后释放；调用者持有分片的 writer_mutex
+    // 增量层过大时先合并
+    static void publish(Shard& shard, std::unique_ptr<Snapshot> next) {
+        if (next->overlay.size() > next->merge_threshold()) {
+            next = next->merged();
+        }
+        const Snapshot* old = shard.current.exchange(next.release(), std::memory_order_seq_cst);
+        EpochDomain::global().retire(old);
+    }
+    
+    std::optional<User> find_user(const UserId& id) const {
+        auto guard = EpochDomain::global().pin();
+        if (const User* user = current_of(shard_for(id)).find(id)) {
+            return *user;
+        }
+        return std::nullopt;
+    }
+    
+    bool add_user(User user) {
+        Shard& shard = shard_for(user.id());
+        std::lock_guard<std::mutex> lock(shard.writer_mutex);
+        
+        // 同一分片的写者互斥，持锁期间当前版本不会被替换或释放
+        const Snapshot& current = *shard.current.load(std::memory_order_relaxed);
+        if (current.find(user.id())) {
+            return false;
+        }
+        auto next = std::make_unique<Snapshot>(current);
+        next->insert(std::make_shared<const User>(std::move(user)));
+        publish(shard, std::move(next));
+        return true;
+    }
+    
+    // 整批查找只进入一次读临界区
+    std::vector<std::optional<User>> find_users(std::span<const UserId> ids) const {
+        std::vector<std::optional<User>> result(ids.size());
+        auto guard = EpochDomain::global().pin();
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (const User* user = current_of(shard_for(ids[i])).find(ids[i])) {
+                result[i] = *user;
+            }
+        }
+        return result;
+    }
+    
+    // 把一个分片的那部分批量用户写入：只复制、发布一次版本；added 按原始下标记录结果
+    static void add_to_shard(Shard& shard, std::vector<std::pair<size_t, User>>& batch, uint8_t* added) {
+        std::lock_guard<std::mutex> lock(shard.writer_mutex);
+        
+        auto next = std::make_unique<Snapshot>(*shard.current.load(std::memory_order_relaxed));
+        next->added.reserve(next->added.size() + batch.size());
+        next->overlay.reserve(next->overlay.size() + batch.size());
+        bool changed = false;
+        for (auto& [position, user] : batch) {
+            if (!next->find(user.id()) && next->insert(std::make_shared<const User>(std::move(user)))) {
+                added[position] = 1;
+                changed = true;
+            }
+        }
+        if (changed) {
+            publish(shard, std::move(next));
+        }
+    }
+    
+    // 整批添加：按分片拆开后各分片并行写入
+    std::vector<bool> add_users(std::vector<User> users) {
+        std::vector<std::vector<std::pair<size_t, User>>> batches(shard_count());
+        for (size_t i = 0; i < users.size(); ++i) {
+            size_t shard = &shard_for(users[i].id()) - shards_.get();
+            batches[shard].emplace_back(i, std::move(users[i]));
+        }
+        
+        std::vector<uint8_t> added(users.size());
+        std::vector<Future<void>> pending;
+        pending.reserve(batches.size());
+        try {
+            for (size_t shard = 0; shard < batches.size(); ++shard) {
+                if (!batches[shard].empty()) {
+                    pending.push_back(executor_.submit([this, shard, &batches, &added] {
+                        add_to_shard(shards_[shard], batches[shard], added.data());
+                    }));
+                }
+            }
+        } catch (...) {
+            // 已提交的任务引用着 batches 和 added
+            wait_all(pending);
+            throw;
+        }
+        if (auto error = wait_all(pending)) {
+            std::rethrow_exception(error);
+        }
+        return std::vector<bool>(added.begin(), added.end());
+    }
+    
+    // 只修改增量层，主体保持共享
+    bool remove_user(const UserId& id) {
+        Shard& shard = shard_for(id);
+        std::lock_guard<std::mutex> lock(shard.writer_mutex);
+        
+        const Snapshot& current = *shard.current.load(std::memory_order_relaxed);
+        if (!current.find(id)) {
             return false;
+        }
+        auto next = std::make_unique<Snapshot>(current);
+        next->erase(id);
+        publish(shard, std::move(next));
+        return true;
+    }
+    
+public:
+    // 任务提交到线程池执行，不再为每次调用创建线程；服务须比其上未完成的任务存活更久
+    // shard_count 向上取整为 2 的幂，默认取硬件线程数
+    explicit AsyncUserService(WorkStealingExecutor& executor = WorkStealingExecutor::global(),
+                              size_t shard_count = default_shard_count())
+        : shards_(new Shard[std::bit_ceil(std::max<size_t>(shard_count, 1))])
+        , shard_bits_(static_cast<size_t>(std::countr_zero(std::bit_ceil(std::max<size_t>(shard_count, 1)))))
+        , executor_(executor) {
+        for (size_t i = 0; i < this->shard_count(); ++i) {
+            shards_[i].current.store(new Snapshot(), std::memory_order_relaxed);
+        }
+    }
+    
+    // 不能在读临界区内析构
+    ~AsyncUserService() {
+        for (size_t i = 0; i < shard_count(); ++i) {
+            delete shards_[i].current.load();
+        }
+        EpochDomain::global().synchronize();
+    }
+    
+    AsyncUserService(const AsyncUserService&) = delete;
+    AsyncUserService& operator=(const AsyncUserService&) = delete;
+    
+    // 异步查找用户
+    Future<std::optional<User>> find_user_async(const UserId& id) const {
+        return executor_.submit([this, id] { return find_user(id); });
+    }
+    
+    // 回调版本：在工作线程上以结果调用 callback
+    template<typename Callback>
+    void find_user_async(const UserId& id, Callback&& callback) const {
+        executor_.post([this, id, callback = std::forward<Callback>(callback)]() mutable {
+            callback(find_user(id));
+        });
+    }
+    
+    // 异步添加用户
+    Future<bool> add_user_async(User user) {
+        return executor_.submit([this, user = std::move(user)]() mutable { return add_user(std::move(user)); });
+    }
+    
+    template<typename Callback>
+    void add_user_async(User user, Callback&& callback) {
+        executor_.post([this, user = std::move(user), callback = std::forward<Callback>(callback)]() mutable {
+            callback(add_user(std::move(user)));
         });
     }
     
-    // 批量处理用户
+    // 批量查找：一个任务，结果与 ids 一一对应；ids 在提交时复制
+    Future<std::vector<std::optional<User>>> find_users_async(std::span<const UserId> ids) const {
+        return executor_.submit([this, ids = std::vector<UserId>(ids.begin(), ids.end())] {
+            return find_users(ids);
+        });
+    }
+    
+    // 批量添加：结果与 users 一一对应，已存在（包括批内重复）的用户为 false
+    Future<std::vector<bool>> add_users_async(std::vector<User> users) {
+        return executor_.submit([this, users = std::move(users)]() mutable {
+            return add_users(std::move(users));
+        });
+    }
+    
+    // 异步删除用户
+    Future<bool> remove_user_async(const UserId& id) {
+        return executor_.submit([this, id] { return remove_user(id); });
+    }
+    
+    // 批量处理用户：各分片在线程池中并行遍历，func 会被多个线程同时调用；
+    // 每个分片遍历的是该分片的一致版本，不阻塞写者，遍历期间旧版本推迟释放
     template<typename Func>
     void for_each_user(Func&& func) const {
-        std::shared_lock<std::shared_mutex> lock(users_mutex_);
-        std::for_each(users_.begin(), users_.end(), std::forward<Func>(func));
+        std::vector<Future<void>> pending;
+        pending.reserve(shard_count());
+        try {
+            for (size_t i = 0; i < shard_count(); ++i) {
+                pending.push_back(executor_.submit([&shard = shards_[i], &func] {
+                    auto guard = EpochDomain::global().pin();
+                    current_of(shard).for_each(func);
+                }));
+            }
+        } catch (...) {
+            wait_all(pending);
+            throw;
+        }
+        if (auto error = wait_all(pending)) {
+            std::rethrow_exception(error);
+        }
     }
 };
 
@@ -412,6 +2465,75 @@ int main() {
         }
         std::cout << std::endl;
         
+        // 单线程使用无锁策略；大块 POD 数组扩容由 mremap 完成，不拷贝数据
+        SmartArray<double, 0, HugePageAllocator, DoublingGrowth, NoLock> samples(1024);
+        for (int i = 0; i < 1000000; ++i) {
+            samples.push_back(i * 0.5);
+        }
+        std::cout << "采样数组: " << samples.size() << " 个, 容量 " << samples.capacity()
+                  << ", 最后一个 " << samples[samples.size() - 1] << std::endl;
+        
+        // 连续迭代器上的并行算法：变换与排序分摊到多个核心并向量化
+        std::transform(std::execution::par_unseq, samples.begin(), samples.end(), samples.begin(),
+                       [](double x) { return x * x; });
+        std::sort(std::execution::par_unseq, samples.begin(), samples.end(), std::greater<>());
+        double sample_sum = std::reduce(std::execution::par_unseq, samples.begin(), samples.end());
+        std::cout << "并行处理后: 最大 " << samples[0] << ", 总和 " << sample_sum << std::endl;
+        
+        // 批量操作与一致性快照
+        std::vector<int> more{121, 144, 169};
+        numbers.reserve(32);
+        numbers.append_range(more);
+        numbers.append_range(numbers.span().first(2));   // 追加自身的元素也安全
+        {
+            auto view = numbers.snapshot();
+            std::cout << "快照: " << view.size() << " 个元素, 总和 "
+                      << std::reduce(std::execution::par_unseq, view.begin(), view.end()) << std::endl;
+        }
+        SmartArray<int, 8> window;
+        window.assign(numbers.span().last(3));
+        std::cout << "窗口: " << window[0] << " " << window[1] << " " << window[2] << std::endl;
+        
+        // 从内存区分配，1.5 倍增长，自旋锁保护
+        Arena arena(64 * 1024);
+        SmartArray<std::string, 0, ArenaAllocator, GoldenGrowth, SpinLock> names(4, ArenaAllocator(arena));
+        for (const char* name : {"alice", "bob", "carol", "dave", "eve", "frank"}) {
+            names.emplace_back(name);
+        }
+        std::cout << "名字数组: " << names.size() << " 个, 容量 " << names.capacity()
+                  << ", 内存区已用 " << arena.used() << " 字节" << std::endl;
+        
+        // 小数组存放在对象内部：外层 8 行、每行 4 个元素都不需要堆分配
+        SmartArray<SmartArray<int, 4>, 8> grid;
+        for (int row = 0; row < 3; ++row) {
+            grid.emplace_back();
+            for (int col = 0; col < 4; ++col) {
+                grid[row].push_back(row * 4 + col);
+            }
+        }
+        grid[2].push_back(12);   // 第三行超出 4 个元素，转移到堆上
+        std::cout << "二维数组: " << grid.size() << " 行, 第三行 " << grid[2].size() << " 个元素, 末尾 "
+                  << grid[2][4] << std::endl;
+        
+        // 多个生产者并发追加到共享事件缓冲区
+        ConcurrentSegmentedArray<std::string> events;
+        const std::string& first_event = events.emplace_back("server started");
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; ++t) {
+            producers.emplace_back([&events, t] {
+                for (int i = 0; i < 1000; ++i) {
+                    events.push_back("producer " + std::to_string(t) + " event " + std::to_string(i));
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        size_t event_bytes = 0;
+        events.for_each([&event_bytes](const std::string& event) { event_bytes += event.size(); });
+        std::cout << "事件缓冲区: " << events.size() << " 条, " << event_bytes << " 字节, 首条仍为 \""
+                  << first_event << "\"" << std::endl;
+        
         // 创建用户
         auto user1 = User(
             UserId(1001),
@@ -448,6 +2570,73 @@ int main() {
                       << " (" << found_user->email() << ")" << std::endl;
         }
         
+        // 删除用户后索引同步更新
+        bool removed = service.remove_user_async(UserId(1001)).get();
+        std::cout << "删除用户: " << std::boolalpha << removed << ", 再次查找: "
+                  << service.find_user_async(UserId(1001)).get().has_value() << std::endl;
+        
+        // 批量导入与批量查找：整批只提交一个任务
+        std::vector<User> imported;
+        for (uint64_t id = 2000; id < 2000 + 100000; ++id) {
+            imported.emplace_back(UserId(id), UserName("user" + std::to_string(id)),
+                                  "user" + std::to_string(id) + "@example.com");
+        }
+        auto import_start = std::chrono::steady_clock::now();
+        auto added = service.add_users_async(std::move(imported)).get();
+        std::vector<UserId> wanted;
+        for (uint64_t id = 1990; id < 1990 + 1000; ++id) {
+            wanted.emplace_back(id);
+        }
+        auto batch = service.find_users_async(wanted).get();
+        auto import_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - import_start).count();
+        std::cout << "批量导入: " << std::count(added.begin(), added.end(), true) << " 个, 批量查找命中 "
+                  << std::count_if(batch.begin(), batch.end(), [](const auto& user) { return user.has_value(); })
+                  << "/" << batch.size() << ", 耗时 " << import_ms << " ms" << std::endl;
+        
+        // 各分片并行遍历一致的快照，期间写者照常发布新版本
+        std::atomic<size_t> example_users{0};
+        service.for_each_user([&example_users](const User& user) {
+            if (user.email().ends_with("@example.com")) {
+                example_users.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        std::cout << "快照遍历: " << example_users.load() << " 个 example.com 用户" << std::endl;
+        
+        // 大量并发查找：回调版本不分配 Future，全部在线程池中完成
+        constexpr int kLookups = 200000;
+        std::atomic<int> hits{0};
+        std::atomic<int> done{0};
+        auto lookup_start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLookups; ++i) {
+            service.find_user_async(UserId(1001 + i % 4), [&hits, &done](const std::optional<User>& user) {
+                if (user) {
+                    hits.fetch_add(1, std::memory_order_relaxed);
+                }
+                done.fetch_add(1, std::memory_order_release);
+            });
+        }
+        while (done.load(std::memory_order_acquire) < kLookups) {
+            std::this_thread::yield();
+        }
+        auto lookup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lookup_start).count();
+        std::cout << "并发查找: " << kLookups << " 次, 命中 " << hits.load() << ", 耗时 "
+                  << lookup_ms << " ms" << std::endl;
+        
+        // 列式存储上的分析扫描：只读取创建时间列与激活位图
+        ColumnarUserStore columns;
+        constexpr size_t kColumnRows = 2000000;
+        auto scan_now = std::chrono::system_clock::now();
+        columns.reserve(kColumnRows);
+        for (size_t i = 0; i < kColumnRows; ++i) {
+            columns.append(UserId(i), "user" + std::to_string(i), "user" + std::to_string(i) + "@example.com",
+                           i % 3 != 0, scan_now - std::chrono::days(i % 3650));
+        }
+        auto scan_start = std::chrono::steady_clock::now();
+        size_t veterans = columns.count_active_older_than(std::chrono::days(365), scan_now);
+        auto scan_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scan_start).count();
+        std::cout << "列式扫描 (" << ColumnarUserStore::filter_kernel_name() << "): " << columns.count_active()
+                  << " 个激活用户中 " << veterans << " 个注册超过一年, 耗时 " << scan_ms << " ms" << std::endl;
+        
         // 用户操作示例
         std::vector<UserAction> actions = {
             Login{"192.168.1.100"},
@@ -0,0 +1,887 @@
+/**
+ * LitheServer C++20 协程处理层
+ * 在 C 服务器（example.c）的文件缓存与缓冲区池之上，用每线程一个 epoll 反应器驱动协程，
+ * 处理函数可以顺序书写而不占用线程：
+ *
+ *     co_await conn.read_request();
+ *     co_await conn.send_file(path);
+ *     co_await sleep(100ms);
+ *
+ * 协程帧从每个工作线程自己的帧池分配，不经过全局堆。
+ *
+ * 构建：
+ *     gcc -O2 -pthread -DLITHE_NO_MAIN -c example.c -o example.o
+ *     g++ -std=c++20 -O2 -pthread example_coro.cpp example.o -o example_coro
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// example.c 导出的接口
+extern "C" {
+typedef struct {
+    int fd;
+    uint64_t size;
+    const char* content_type;
+    void* handle;
+} lithe_file_t;              // 与 example.c 中的定义一致
+
+int create_server_socket(int port);
+int start_file_watcher(const char* root);
+int lithe_open_file(const char* url_path, lithe_file_t* file);
+void lithe_close_file(lithe_file_t* file);
+char* io_buffer_get(void);
+void io_buffer_put(char* buffer);
+void log_message(const char* level, const char* format, ...);
+}
+
+namespace LitheServer {
+
+constexpr std::size_t kIoBufferSize = 16384;              // 与 example.c 的 IO_BUFFER_SIZE 一致
+constexpr std::int64_t kIdleTimeoutNs = 5'000'000'000;    // 等待客户端或发送无进展超过该时间即断开
+constexpr std::int64_t kNoIdleDeadline = INT64_MAX;       // 处理函数自身挂起（如定时器）期间不计空闲
+constexpr int kMaxSleepMs = 4'000;                        // /api/sleep 上限，低于空闲超时
+constexpr std::int64_t kSweepIntervalNs = 1'000'000'000;
+
+inline std::int64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ---------- 协程帧池 ----------
+
+/**
+ * 每线程的协程帧分配器：按 2 的幂分级的空闲链表，块从 64KB 的板上切出
+ * 协程只在创建它的工作线程上运行和销毁，因此无需加锁；超过最大级别的帧退回全局堆
+ */
+class FramePool {
+public:
+    static FramePool& local() {
+        thread_local FramePool pool;
+        return pool;
+    }
+
+    void* allocate(std::size_t size) {
+        std::size_t cls = size_class(size);
+        if (cls == kClassCount) {
+            ++heap_allocations_;
+            return ::operator new(size);
+        }
+        if (!free_[cls]) {
+            refill(cls);
+        }
+        FreeBlock* block = free_[cls];
+        free_[cls] = block->next;
+        ++pool_allocations_;
+        return block;
+    }
+
+    void deallocate(void* ptr, std::size_t size) noexcept {
+        std::size_t cls = size_class(size);
+        if (cls == kClassCount) {
+            ::operator delete(ptr);
+            return;
+        }
+        auto* block = static_cast<FreeBlock*>(ptr);
+        block->next = free_[cls];
+        free_[cls] = block;
+    }
+
+    [[nodiscard]] std::uint64_t pool_allocations() const noexcept { return pool_allocations_; }
+    [[nodiscard]] std::uint64_t heap_allocations() const noexcept { return heap_allocations_; }
+    [[nodiscard]] std::size_t slab_bytes() const noexcept { return slabs_.size() * kSlabSize; }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static constexpr std::size_t kMinBlock = 128;
+    static constexpr std::size_t kClassCount = 6;         // 128B .. 4KB
+    static constexpr std::size_t kSlabSize = 64 * 1024;
+
+    static std::size_t size_class(std::size_t size) noexcept {
+        std::size_t cls = 0;
+        for (std::size_t block = kMinBlock; block < size; block <<= 1) {
+            if (++cls == kClassCount) {
+                break;
+            }
+        }
+        return cls;
+    }
+
+    void refill(std::size_t cls) {
+        std::size_t block_size = kMinBlock << cls;
+        auto slab = std::make_unique<std::byte[]>(kSlabSize);
+        for (std::size_t offset = 0; offset + block_size <= kSlabSize; offset += block_size) {
+            auto* block = reinterpret_cast<FreeBlock*>(slab.get() + offset);
+            block->next = free_[cls];
+            free_[cls] = block;
+        }
+        slabs_.push_back(std::move(slab));
+    }
+
+    FreeBlock* free_[kClassCount] = {};
+    std::vector<std::unique_ptr<std::byte[]>> slabs_;
+    std::uint64_t pool_allocations_ = 0;
+    std::uint64_t heap_allocations_ = 0;
+};
+
+// 所有协程的 promise 都继承它，帧的分配与释放落到当前线程的帧池
+struct PooledFrame {
+    static void* operator new(std::size_t size) { return FramePool::local().allocate(size); }
+    static void operator delete(void* ptr, std::size_t size) noexcept { FramePool::local().deallocate(ptr, size); }
+};
+
+// ---------- Task<T> ----------
+
+template<typename T>
+struct TaskResult {
+    std::optional<T> value;
+
+    template<typename U>
+    void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+    T take() { return std::move(*value); }
+};
+
+template<>
+struct TaskResult<void> {
+    void return_void() noexcept {}
+    void take() noexcept {}
+};
+
+/**
+ * 惰性启动的协程：被 co_await 时才开始执行，结束时对称转移回等待者
+ */
+template<typename T = void>
+class [[nodiscard]] Task {
+public:
+    struct promise_type : PooledFrame, TaskResult<T> {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        Task get_return_object() noexcept {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                auto next = handle.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+                handle.promise().continuation = caller;
+                return handle;
+            }
+            T await_resume() {
+                if (handle.promise().error) {
+                    std::rethrow_exception(handle.promise().error);
+                }
+                return handle.promise().take();
+            }
+        };
+        return Awaiter{handle_};
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// ---------- 反应器 ----------
+
+// 一个文件描述符上的等待者：同一时刻只有一个协程在等待它可读或可写
+struct IoWaiter {
+    int fd = -1;
+    std::coroutine_handle<> handle;
+    std::uint32_t interest = 0;
+    std::int64_t idle_deadline_ns = 0;    // 0 表示不参与空闲超时
+    IoWaiter* prev = nullptr;
+    IoWaiter* next = nullptr;
+};
+
+class Reactor;
+
+/**
+ * 即发即弃的顶层协程（每个连接一个）：立即开始执行，结束时自行释放帧
+ * promise 构造时登记到当前线程的反应器，反应器停止时销毁仍挂起的协程
+ */
+class Detached {
+public:
+    struct promise_type : PooledFrame {
+        promise_type* prev = nullptr;
+        promise_type* next = nullptr;
+
+        promise_type();
+        ~promise_type();
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {
+            try {
+                std::rethrow_exception(std::current_exception());
+            } catch (const std::exception& e) {
+                log_message("ERROR", "Coroutine handler failed: %s", e.what());
+            } catch (...) {
+                log_message("ERROR", "Coroutine handler failed");
+            }
+        }
+    };
+};
+
+/**
+ * 每个工作线程一个：epoll 等待 I/O 就绪，最小堆维护定时器，
+ * 并定期断开长时间没有进展的连接
+ */
+class Reactor {
+public:
+    Reactor() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;              // 空指针表示唤醒事件
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+    }
+
+    ~Reactor() {
+        close(wake_fd_);
+        close(epoll_fd_);
+    }
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    static Reactor& current() { return *current_; }
+
+    /**
+     * 在当前线程运行事件循环直到 stop()，退出前销毁仍挂起的协程
+     */
+    void run(int listen_fd, int worker_index);
+
+    void stop() {
+        std::uint64_t one = 1;
+        stopping_.store(true, std::memory_order_release);
+        if (write(wake_fd_, &one, sizeof(one)) < 0) {
+            // 计数器溢出也意味着已有未处理的唤醒
+        }
+    }
+
+    [[nodiscard]] bool stopping() const noexcept { return stopping_.load(std::memory_order_acquire); }
+
+    /**
+     * 注册描述符；connection 为 true 时使用边沿触发并参与空闲超时
+     */
+    void watch(IoWaiter& waiter, bool connection) {
+        epoll_event event{};
+        event.data.ptr = &waiter;
+        if (connection) {
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            waiter.idle_deadline_ns = monotonic_ns() + kIdleTimeoutNs;
+            waiter.next = connections_;
+            if (connections_) {
+                connections_->prev = &waiter;
+            }
+            connections_ = &waiter;
+        } else {
+            // 所有工作线程共享监听套接字，EPOLLEXCLUSIVE 避免一个连接唤醒全部线程
+            event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        }
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, waiter.fd, &event);
+    }
+
+    void unwatch(IoWaiter& waiter) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, waiter.fd, nullptr);
+        if (waiter.idle_deadline_ns == 0) {
+            return;
+        }
+        if (waiter.prev) {
+            waiter.prev->next = waiter.next;
+        } else if (connections_ == &waiter) {
+            connections_ = waiter.next;
+        }
+        if (waiter.next) {
+            waiter.next->prev = waiter.prev;
+        }
+        waiter.prev = waiter.next = nullptr;
+    }
+
+    void add_timer(std::int64_t deadline_ns, std::coroutine_handle<> handle) {
+        timers_.push(Timer{deadline_ns, handle});
+    }
+
+    void adopt(Detached::promise_type& task) noexcept {
+        task.next = detached_;
+        if (detached_) {
+            detached_->prev = &task;
+        }
+        detached_ = &task;
+    }
+
+    void release(Detached::promise_type& task) noexcept {
+        if (task.prev) {
+            task.prev->next = task.next;
+        } else {
+            detached_ = task.next;
+        }
+        if (task.next) {
+            task.next->prev = task.prev;
+        }
+    }
+
+private:
+    struct Timer {
+        std::int64_t deadline_ns;
+        std::coroutine_handle<> handle;
+        bool operator>(const Timer& other) const noexcept { return deadline_ns > other.deadline_ns; }
+    };
+
+    int next_timeout_ms(std::int64_t now) const {
+        std::int64_t until = next_sweep_ns_ - now;
+        if (!timers_.empty()) {
+            until = std::min(until, timers_.top().deadline_ns - now);
+        }
+        return until <= 0 ? 0 : static_cast<int>((until + 999'999) / 1'000'000);
+    }
+
+    void run_due_timers(std::int64_t now) {
+        while (!timers_.empty() && timers_.top().deadline_ns <= now) {
+            auto handle = timers_.top().handle;
+            timers_.pop();
+            handle.resume();
+        }
+    }
+
+    // 关闭读写方向后等待者会收到 EPOLLHUP，由处理函数自己走正常的结束路径
+    void sweep_idle(std::int64_t now) {
+        for (IoWaiter* waiter = connections_; waiter; waiter = waiter->next) {
+            if (waiter->idle_deadline_ns < now) {
+                shutdown(waiter->fd, SHUT_RDWR);
+            }
+        }
+        next_sweep_ns_ = now + kSweepIntervalNs;
+    }
+
+    static thread_local Reactor* current_;
+
+    int epoll_fd_;
+    int wake_fd_;
+    std::atomic<bool> stopping_{false};
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers_;
+    IoWaiter* connections_ = nullptr;
+    std::int64_t next_sweep_ns_ = 0;
+    Detached::promise_type* detached_ = nullptr;
+};
+
+thread_local Reactor* Reactor::current_ = nullptr;
+
+Detached::promise_type::promise_type() {
+    Reactor::current().adopt(*this);
+}
+
+Detached::promise_type::~promise_type() {
+    Reactor::current().release(*this);
+}
+
+// ---------- 可等待操作 ----------
+
+// 挂起直到描述符可读（EPOLLIN）或可写（EPOLLOUT）
+struct ReadyAwaiter {
+    IoWaiter& waiter;
+    std::uint32_t interest;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) noexcept {
+        waiter.handle = handle;
+        waiter.interest = interest;
+    }
+    void await_resume() const noexcept {}
+};
+
+struct SleepAwaiter {
+    std::int64_t deadline_ns;
+
+    bool await_ready() const noexcept { return deadline_ns <= monotonic_ns(); }
+    void await_suspend(std::coroutine_handle<> handle) { Reactor::current().add_timer(deadline_ns, handle); }
+    void await_resume() const noexcept {}
+};
+
+/**
+ * co_await sleep(100ms)：挂起当前协程，工作线程继续处理其他连接
+ */
+template<typename Rep, typename Period>
+SleepAwaiter sleep(std::chrono::duration<Rep, Period> duration) {
+    return SleepAwaiter{monotonic_ns() + std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()};
+}
+
+struct Request {
+    std::string method;
+    std::string target;
+    std::string version;
+    std::vector<std::pair<std::string, std::string>> headers;
+
+    [[nodiscard]] std::optional<std::string_view> header(std::string_view name) const {
+        for (const auto& [key, value] : headers) {
+            if (key.size() == name.size() && strncasecmp(key.data(), name.data(), name.size()) == 0) {
+                return value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // HTTP/1.1 默认长连接，HTTP/1.0 需显式要求
+    [[nodiscard]] bool keep_alive() const {
+        auto connection = header("Connection");
+        if (connection) {
+            return connection->size() == 10 && strncasecmp(connection->data(), "keep-alive", 10) == 0;
+        }
+        return version == "HTTP/1.1";
+    }
+};
+
+/**
+ * 一个客户端连接：持有套接字和从 C 缓冲区池借来的接收缓冲区，析构时归还并关闭
+ */
+class Connection {
+public:
+    explicit Connection(int fd) : buffer_(io_buffer_get()) {
+        waiter_.fd = fd;
+        Reactor::current().watch(waiter_, true);
+    }
+
+    Connection(Connection&& other) = delete;
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    ~Connection() {
+        Reactor::current().unwatch(waiter_);
+        close(waiter_.fd);
+        if (buffer_) {
+            io_buffer_put(buffer_);
+        }
+    }
+
+    [[nodiscard]] int fd() const noexcept { return waiter_.fd; }
+
+    /**
+     * 读取下一个请求的请求行与头部；请求体（若有）读取后丢弃
+     * @return 连接关闭、超时或请求无效时返回空
+     */
+    Task<std::optional<Request>> read_request() {
+        if (!buffer_) {
+            co_return std::nullopt;
+        }
+        touch();                               // 从这里开始等待客户端的下一个请求
+        for (;;) {
+            std::string_view pending(buffer_ + start_, end_ - start_);
+            std::size_t head_end = pending.find("\r\n\r\n");
+            if (head_end != std::string_view::npos) {
+                std::optional<Request> request = parse(pending.substr(0, head_end));
+                start_ += head_end + 4;
+                if (request && !body_length(*request)) {
+                    // 无法确定请求体边界，继续读下去会把请求体当成下一个请求
+                    co_await send_response(400, "Bad Request", "text/html; charset=utf-8", "<h1>400</h1>", false);
+                    co_return std::nullopt;
+                }
+                if (request && !co_await discard_body(*request)) {
+                    co_return std::nullopt;
+                }
+                // 处理函数运行期间只有发送会重新计时，定时器等挂起不算空闲
+                waiter_.idle_deadline_ns = kNoIdleDeadline;
+                co_return request;
+            }
+            if (start_ > 0) {
+                std::memmove(buffer_, buffer_ + start_, end_ - start_);
+                end_ -= start_;
+                start_ = 0;
+            }
+            if (end_ == kIoBufferSize) {
+                co_return std::nullopt;        // 头部超出缓冲区
+            }
+            if (!co_await receive()) {
+                co_return std::nullopt;
+            }
+        }
+    }
+
+    /**
+     * 发送完整的数据，套接字缓冲区满时挂起等待可写
+     */
+    Task<bool> send(std::string_view data) {
+        touch();
+        while (!data.empty()) {
+            ssize_t n = ::send(waiter_.fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (n > 0) {
+                data.remove_prefix(static_cast<std::size_t>(n));
+                touch();
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                co_await ReadyAwaiter{waiter_, EPOLLOUT};
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                co_return false;
+            }
+        }
+        co_return true;
+    }
+
+    Task<bool> send_response(int status, std::string_view reason, std::string_view content_type,
+                             std::string_view body, bool keep_alive) {
+        std::string head = "HTTP/1.1 " + std::to_string(status) + " " + std::string(reason) + "\r\n" +
+                           "Content-Type: " + std::string(content_type) + "\r\n" +
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+                           (keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n") +
+                           "Server: LitheServer/1.0\r\n\r\n";
+        head.append(body);
+        co_return co_await send(head);
+    }
+
+    /**
+     * 经 C 服务器的文件缓存发送静态文件，正文用 sendfile 从共享描述符按偏移发送
+     * @param path 请求路径
+     * @param head_only HEAD 请求只发送头部
+     * @return 连接仍可继续使用时返回 true
+     */
+    Task<bool> send_file(const std::string& path, bool head_only, bool keep_alive) {
+        lithe_file_t file{};
+        int status = lithe_open_file(path.c_str(), &file);
+        if (status != 0) {
+            std::string body = "<h1>" + std::to_string(status) + "</h1>";
+            co_return co_await send_response(status, status == 403 ? "Forbidden" : "Not Found",
+                                             "text/html; charset=utf-8", body, keep_alive);
+        }
+
+        std::string head = "HTTP/1.1 200 OK\r\n" + std::string(file.content_type) + "\r\n" +
+                           "Content-Length: " + std::to_string(file.size) + "\r\n" +
+                           (keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n") +
+                           "Server: LitheServer/1.0\r\n\r\n";
+        bool ok = co_await send(head);
+        off_t offset = 0;
+        touch();
+        while (ok && !head_only && static_cast<std::uint64_t>(offset) < file.size) {
+            ssize_t n = sendfile(waiter_.fd, file.fd, &offset, file.size - static_cast<std::uint64_t>(offset));
+            if (n > 0) {
+                touch();
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                co_await ReadyAwaiter{waiter_, EPOLLOUT};
+            } else if (!(n < 0 && errno == EINTR)) {
+                ok = false;                    // 文件被截断（n == 0）或连接出错
+            }
+        }
+        lithe_close_file(&file);
+        co_return ok;
+    }
+
+private:
+    void touch() noexcept { waiter_.idle_deadline_ns = monotonic_ns() + kIdleTimeoutNs; }
+
+    // 读一次数据到缓冲区末尾，没有数据时挂起等待
+    Task<bool> receive() {
+        for (;;) {
+            ssize_t n = recv(waiter_.fd, buffer_ + end_, kIoBufferSize - end_, 0);
+            if (n > 0) {
+                end_ += static_cast<std::size_t>(n);
+                touch();
+                co_return true;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                co_return false;
+            }
+            if (errno != EINTR) {
+                co_await ReadyAwaiter{waiter_, EPOLLIN};
+            }
+        }
+    }
+
+    /**
+     * 请求体长度：不解码 chunked，带 Transfer-Encoding（包括与 Content-Length 并存）的请求一律拒绝；
+     * Content-Length 必须唯一且为十进制数字
+     * @return 分帧无效时返回空
+     */
+    static std::optional<std::uint64_t> body_length(const Request& request) {
+        std::optional<std::string_view> length;
+        for (const auto& [key, value] : request.headers) {
+            if (strcasecmp(key.c_str(), "Transfer-Encoding") == 0) {
+                return std::nullopt;
+            }
+            if (strcasecmp(key.c_str(), "Content-Length") == 0) {
+                if (length) {
+                    return std::nullopt;
+                }
+                length = value;
+            }
+        }
+        if (!length) {
+            return 0;
+        }
+        std::uint64_t result = 0;
+        auto [end, error] = std::from_chars(length->data(), length->data() + length->size(), result);
+        if (length->empty() || error != std::errc() || end != length->data() + length->size()) {
+            return std::nullopt;
+        }
+        return result;
+    }
+
+    Task<bool> discard_body(const Request& request) {
+        std::uint64_t remaining = *body_length(request);
+        while (remaining > 0) {
+            if (start_ == end_) {
+                start_ = end_ = 0;
+                if (!co_await receive()) {
+                    co_return false;
+                }
+            }
+            std::size_t take = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, end_ - start_));
+            start_ += take;
+            remaining -= take;
+        }
+        co_return true;
+    }
+
+    static std::optional<Request> parse(std::string_view head) {
+        Request request;
+        std::size_t line_end = head.find("\r\n");
+        std::string_view line = head.substr(0, line_end);
+        std::size_t first = line.find(' ');
+        std::size_t second = first == std::string_view::npos ? first : line.find(' ', first + 1);
+        if (second == std::string_view::npos) {
+            return std::nullopt;
+        }
+        request.method = line.substr(0, first);
+        request.target = line.substr(first + 1, second - first - 1);
+        request.version = line.substr(second + 1);
+
+        while (line_end != std::string_view::npos) {
+            std::size_t next = head.find("\r\n", line_end + 2);
+            line = head.substr(line_end + 2, next == std::string_view::npos ? next : next - line_end - 2);
+            line_end = next;
+            std::size_t colon = line.find(':');
+            if (colon == std::string_view::npos) {
+                continue;
+            }
+            std::string_view value = line.substr(colon + 1);
+            while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+                value.remove_prefix(1);
+            }
+            request.headers.emplace_back(line.substr(0, colon), value);
+        }
+        return request;
+    }
+
+    IoWaiter waiter_;
+    char* buffer_;
+    std::size_t start_ = 0;                // 未消费数据的起止位置
+    std::size_t end_ = 0;
+};
+
+// ---------- 处理函数 ----------
+
+/**
+ * 单个连接的处理流程：顺序书写，每个 co_await 处让出工作线程
+ */
+Detached serve_connection(int fd) {
+    Connection conn(fd);
+
+    while (auto request = co_await conn.read_request()) {
+        bool keep_alive = request->keep_alive() && !Reactor::current().stopping();
+        bool ok;
+
+        if (request->target.rfind("/api/sleep", 0) == 0) {
+            // 演示：定时器挂起期间同一线程继续服务其他连接
+            std::size_t ms_pos = request->target.find("ms=");
+            int ms = ms_pos == std::string::npos ? 100 : std::atoi(request->target.c_str() + ms_pos + 3);
+            ms = std::clamp(ms, 0, kMaxSleepMs);
+            co_await sleep(std::chrono::milliseconds(ms));
+            ok = co_await conn.send_response(200, "OK", "application/json",
+                                             "{\"slept_ms\":" + std::to_string(ms) + "}", keep_alive);
+        } else if (request->method == "GET" || request->method == "HEAD") {
+            ok = co_await conn.send_file(request->target, request->method == "HEAD", keep_alive);
+        } else {
+            ok = co_await conn.send_response(405, "Method Not Allowed", "text/html; charset=utf-8",
+                                             "<h1>405</h1>", false);
+            keep_alive = false;
+        }
+        if (!ok || !keep_alive) {
+            break;
+        }
+    }
+}
+
+/**
+ * 接受循环：每个工作线程一个，从共享的监听套接字接受连接并为每个连接启动处理协程
+ */
+Detached accept_loop(int listen_fd) {
+    IoWaiter listener;
+    listener.fd = listen_fd;
+    Reactor::current().watch(listener, false);
+
+    while (!Reactor::current().stopping()) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd >= 0) {
+            serve_connection(fd);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            co_await ReadyAwaiter{listener, EPOLLIN};
+        } else if (errno != EINTR && errno != ECONNABORTED) {
+            log_message("ERROR", "accept failed: %s", std::strerror(errno));
+            co_await sleep(std::chrono::milliseconds(100));   // 如 EMFILE，稍后重试
+        }
+    }
+    Reactor::current().unwatch(listener);
+}
+
+void Reactor::run(int listen_fd, int worker_index) {
+    epoll_event events[64];
+
+    current_ = this;
+    next_sweep_ns_ = monotonic_ns() + kSweepIntervalNs;
+    accept_loop(listen_fd);
+
+    while (!stopping()) {
+        int n = epoll_wait(epoll_fd_, events, 64, next_timeout_ms(monotonic_ns()));
+        if (n < 0 && errno != EINTR) {
+            log_message("ERROR", "epoll_wait failed: %s", std::strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            auto* waiter = static_cast<IoWaiter*>(events[i].data.ptr);
+            if (!waiter) {
+                std::uint64_t count;
+                if (read(wake_fd_, &count, sizeof(count)) < 0) {
+                    // 非阻塞读，没有计数时忽略
+                }
+                continue;
+            }
+            // 挂断与错误同时唤醒读写等待者，由后续系统调用取得具体错误
+            if (waiter->handle && (events[i].events & (waiter->interest | EPOLLHUP | EPOLLERR | EPOLLRDHUP))) {
+                std::exchange(waiter->handle, {}).resume();
+            }
+        }
+
+        std::int64_t now = monotonic_ns();
+        run_due_timers(now);
+        if (now >= next_sweep_ns_) {
+            sweep_idle(now);
+        }
+    }
+
+    // 销毁仍挂起的协程（接受循环与未完成的连接），帧在本线程归还帧池
+    while (detached_) {
+        std::coroutine_handle<Detached::promise_type>::from_promise(*detached_).destroy();
+    }
+
+    FramePool& pool = FramePool::local();
+    log_message("INFO", "Worker %d: %llu coroutine frames from pool (%zu KB of slabs), %llu from heap",
+                worker_index, static_cast<unsigned long long>(pool.pool_allocations()), pool.slab_bytes() / 1024,
+                static_cast<unsigned long long>(pool.heap_allocations()));
+    current_ = nullptr;
+}
+
+} // namespace LitheServer
+
+// 主函数：[端口] [--workers N]
+int main(int argc, char* argv[]) {
+    using namespace LitheServer;
+
+    int port = 8081;
+    int worker_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            worker_count = std::max(1, std::atoi(argv[++i]));
+        } else {
+            port = std::atoi(argv[i]);
+        }
+    }
+
+    // 退出信号由主线程 sigwait 同步处理，工作线程继承屏蔽字
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = create_server_socket(port);
+    if (listen_fd < 0) {
+        return EXIT_FAILURE;
+    }
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    start_file_watcher(".");
+
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < worker_count; ++i) {
+        reactors.push_back(std::make_unique<Reactor>());
+        threads.emplace_back([reactor = reactors.back().get(), listen_fd, i] { reactor->run(listen_fd, i); });
+    }
+    log_message("INFO", "Coroutine server listening on port %d with %d workers", port, worker_count);
+
+    int signal_number = 0;
+    sigwait(&signals, &signal_number);
+    for (auto& reactor : reactors) {
+        reactor->stop();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    close(listen_fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+为 C 服务器生成内嵌静态资源头文件 example_assets.h
+
+默认内嵌 LitheServer Web 界面的样式表与图标，也可以追加其他文件：
+    python3 gen_assets.py > example_assets.h
+    python3 gen_assets.py --asset /static/app.js=app.js > example_assets.h
+
+每个资源预先生成 gzip（以及安装了 brotli 模块时的 br）压缩版本、
+内容哈希（用于 /static/name.<hash>.ext 形式的不可变 URL）
+和完整序列化的 HTTP/1.1 响应头，运行时只需查表加一次 writev。
+"""
+
+import argparse
+import gzip
+import hashlib
+import mimetypes
+import os
+import sys
+
+try:
+    import brotli  # 可选依赖，标准库不提供
+except ImportError:
+    brotli = None
+
+SERVER_HEADER = 'LitheServer/1.0'
+IMMUTABLE_CACHE = 'public, max-age=31536000, immutable'
+REVALIDATE_CACHE = 'no-cache'
+ENCODINGS = ('identity', 'gzip', 'br')
+
+
+def load_ui_assets():
+    """从 Python 版 LitheServer 取出界面资源，保证两端一致"""
+    sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+    from litheserver.server import LitheServerHandler
+
+    return [
+        ('/static/style.css', LitheServerHandler.get_css_content(None).encode('utf-8'), 'text/css; charset=utf-8'),
+        ('/favicon.ico', LitheServerHandler.get_favicon_content(None).encode('utf-8'), 'image/svg+xml'),
+    ]
+
+
+def hashed_path(path, digest):
+    """/static/style.css -> /static/style.<digest>.css"""
+    base, ext = os.path.splitext(path)
+    return f'{base}.{digest}{ext}'
+
+
+def compress_variants(data):
+    """返回 {编码: 字节}，压缩后不更小的变体被丢弃"""
+    variants = {'identity': data}
+    gz = gzip.compress(data, compresslevel=9, mtime=0)
+    if len(gz) < len(data):
+        variants['gzip'] = gz
+    if brotli is not None:
+        br = brotli.compress(data, quality=11)
+        if len(br) < len(data):
+            variants['br'] = br
+    return variants
+
+
+def response_headers(content_type, length, etag, cache_control, encoding):
+    lines = [
+        'HTTP/1.1 200 OK',
+        f'Content-Type: {content_type}',
+        f'Content-Length: {length}',
+        f'ETag: {etag}',
+        f'Cache-Control: {cache_control}',
+        'Vary: Accept-Encoding',
+    ]
+    if encoding != 'identity':
+        lines.append(f'Content-Encoding: {encoding}')
+    lines += ['Connection: close', f'Server: {SERVER_HEADER}', '', '']
+    return '\r\n'.join(lines)
+
+
+def not_modified_headers(etag, cache_control):
+    return '\r\n'.join([
+        'HTTP/1.1 304 Not Modified',
+        f'ETag: {etag}',
+        f'Cache-Control: {cache_control}',
+        'Connection: close',
+        f'Server: {SERVER_HEADER}',
+        '', '',
+    ])
+
+
+def c_string(text):
+    return '"' + text.replace('\\', '\\\\').replace('"', '\\"').replace('\r', '\\r').replace('\n', '\\n') + '"'
+
+
+def c_bytes(name, data):
+    rows = []
+    for i in range(0, len(data), 16):
+        rows.append('    ' + ', '.join(f'0x{b:02x}' for b in data[i:i + 16]) + ',')
+    return f'static const unsigned char {name}[{len(data)}] = {{\n' + '\n'.join(rows) + '\n};\n'
+
+
+def generate(assets):
+    out = [
+        '/* 由 gen_assets.py 生成，请勿手工修改 */',
+        '#ifndef LITHE_EXAMPLE_ASSETS_H',
+        '#define LITHE_EXAMPLE_ASSETS_H',
+        '',
+    ]
+    entries = []
+
+    for index, (path, data, content_type) in enumerate(assets):
+        digest = hashlib.sha256(data).hexdigest()[:16]
+        etag = f'"{digest}"'
+        variants = compress_variants(data)
+
+        for encoding, body in variants.items():
+            out.append(c_bytes(f'asset_{index}_{encoding}', body))
+
+        # 原始 URL 需要协商缓存，带哈希的 URL 可永久缓存
+        for url, cache_control in ((path, REVALIDATE_CACHE), (hashed_path(path, digest), IMMUTABLE_CACHE)):
+            fields = []
+            for encoding in ENCODINGS:
+                if encoding in variants:
+                    body = variants[encoding]
+                    headers = response_headers(content_type, len(body), etag, cache_control, encoding)
+                    fields.append(f'{{ asset_{index}_{encoding}, {len(body)}, {c_string(headers)}, {len(headers)} }}')
+                else:
+                    fields.append('{ NULL, 0, NULL, 0 }')
+            not_modified = not_modified_headers(etag, cache_control)
+            entries.append((url, (
+                f'    {{ {c_string(url)}, {c_string(etag)}, {c_string(content_type)}, {c_string(cache_control)},\n'
+                f'      {c_string(not_modified)}, {len(not_modified)},\n'
+                f'      {{ ' + ',\n        '.join(fields) + ' } },'
+            )))
+
+    # 按路径排序，运行时二分查找
+    entries.sort(key=lambda item: item[0].encode('utf-8'))
+    out.append('static const embedded_asset_t embedded_assets[] = {')
+    out += [text for _, text in entries]
+    out.append('};')
+    out.append(f'#define EMBEDDED_ASSET_COUNT {len(entries)}')
+    out.append('')
+    out.append('#endif /* LITHE_EXAMPLE_ASSETS_H */')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate embedded static assets for the C server')
+    parser.add_argument('--asset', action='append', default=[], metavar='URL=PATH',
+                        help='embed an extra file under the given URL path')
+    parser.add_argument('--no-ui', action='store_true', help='do not embed the LitheServer UI assets')
+    args = parser.parse_args()
+
+    assets = [] if args.no_ui else load_ui_assets()
+    for spec in args.asset:
+        url, _, file_path = spec.partition('=')
+        if not url.startswith('/') or not file_path:
+            parser.error(f'invalid --asset value: {spec}')
+        with open(file_path, 'rb') as f:
+            data = f.read()
+        content_type = mimetypes.guess_type(file_path)[0] or 'application/octet-stream'
+        if content_type.startswith('text/') or content_type in ('application/javascript', 'application/json'):
+            content_type += '; charset=utf-8'
+        assets.append((url, data, content_type))
+
+    sys.stdout.write(generate(assets))
+
+
+if __name__ == '__main__':
+    main()